@@ -0,0 +1,96 @@
+/*
+ *	The PCI Utilities -- Compile the ID List to a Binary Index
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "pciutils.h"
+
+const char program_name[] = "compile-pciids";
+
+static int verbose;
+
+static char options[] = "i:o:v";
+
+static char help_msg[] =
+"Usage: compile-pciids [<switches>]\n"
+"\n"
+"-i <file>\tUse specified ID database instead of %s\n"
+"-o <file>\tWrite the index to <file> instead of <ID database>.idx\n"
+"-v\t\tBe verbose\n"
+;
+
+static void
+warn(char *msg, ...)
+{
+  va_list args;
+
+  va_start(args, msg);
+  fprintf(stderr, "%s: ", program_name);
+  vfprintf(stderr, msg, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+static void
+debug(char *msg, ...)
+{
+  va_list args;
+
+  if (!verbose)
+    return;
+  va_start(args, msg);
+  vfprintf(stdout, msg, args);
+  va_end(args);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct pci_access *pacc;
+  char *index_name = NULL;
+  int i;
+
+  if (argc == 2 && !strcmp(argv[1], "--version"))
+    {
+      puts("compile-pciids version " PCIUTILS_VERSION);
+      return 0;
+    }
+
+  pacc = pci_alloc();
+  pacc->error = die;
+  pacc->warning = warn;
+  pacc->debug = debug;
+
+  while ((i = getopt(argc, argv, options)) != -1)
+    switch (i)
+      {
+      case 'i':
+	pci_set_name_list_path(pacc, optarg, 0);
+	break;
+      case 'o':
+	index_name = optarg;
+	break;
+      case 'v':
+	verbose++;
+	break;
+      default:
+      bad:
+	fprintf(stderr, help_msg, pacc->id_file_name);
+	return 1;
+      }
+  if (optind < argc)
+    goto bad;
+
+  if (!pci_compile_name_list(pacc, index_name))
+    die("Cannot compile %s", pacc->id_file_name);
+  pci_cleanup(pacc);
+  return 0;
+}
@@ -271,5 +271,6 @@ struct pci_methods pm_aix_device = {
   aix_write,
   NULL,                                 /* read_vpd */
   NULL,                                 /* dev_init */
-  NULL                                  /* dev_cleanup */
+  NULL,                                 /* dev_cleanup */
+  NULL                                  /* read_batch */
 };
@@ -207,5 +207,6 @@ struct pci_methods pm_darwin = {
     darwin_write,
     NULL,                                 /* read_vpd */
     NULL,                                 /* dev_init */
-    NULL                                  /* dev_cleanup */
+    NULL,                                 /* dev_cleanup */
+    NULL                                  /* read_batch */
 };
@@ -0,0 +1,89 @@
+#!/bin/sh
+# Convert the PCI ID list to C tables which are linked into libpci
+# (c) 2026 agent <agent@local>
+#
+# Usage: embed-ids.sh [<vendors> [<classes>]] <pci.ids >ids-embedded.h
+#
+# <vendors> and <classes> are comma-separated lists of hexadecimal ID's
+# to embed (empty means all). Vendors restrict vendor, device and subsystem
+# entries, classes restrict class, subclass and prog-if entries.
+
+set -e
+LC_ALL=C
+export LC_ALL
+
+awk -v vendors="$1" -v classes="$2" '
+function wanted(list, id) {
+	return list == "" || index("," tolower(list) ",", "," id ",")
+}
+function pad(id) {
+	return substr("0000" id, length(id) + 1)
+}
+function entry(cat, id1, id2, id3, id4, name) {
+	sub(/^[ \t]+/, "", name)
+	if (name != "")
+		print cat " " pad(id1) pad(id2) " " pad(id3) pad(id4) "\t" name
+}
+{ sub(/\r$/, ""); sub(/[ \t]+$/, "") }
+/^[ \t]*(#|$)/ { next }
+/^C / {
+	cat = "C"; id1 = tolower($2); skip = !wanted(classes, id1)
+	if (!skip)
+		entry(5, id1, "", "", "", substr($0, 5))
+	next
+}
+/^S / { cat = "S"; id1 = tolower($2); skip = !wanted(vendors, id1); next }
+/^[A-Z] / { cat = "?"; skip = 1; next }
+/^[0-9a-fA-F]/ {
+	cat = "V"; id1 = tolower($1); skip = !wanted(vendors, id1)
+	if (!skip)
+		entry(1, id1, "", "", "", substr($0, 5))
+	next
+}
+skip || cat == "?" { next }
+/^\t\t/ {
+	if (cat == "C")
+		entry(7, id1, id2, tolower($1), "", substr($0, 5))
+	else if (cat == "V")
+		entry(3, id1, id2, tolower($1), tolower($2), substr($0, 12))
+	next
+}
+/^\t/ {
+	id2 = tolower($1)
+	if (cat == "C")
+		entry(6, id1, id2, "", "", substr($0, 4))
+	else if (cat == "V")
+		entry(2, id1, id2, "", "", substr($0, 6))
+	else if (cat == "S")
+		entry(4, id1, id2, "", "", substr($0, 6))
+}
+' | sort | awk -F '\t' '
+BEGIN {
+	print "/* Generated from the PCI ID list by embed-ids.sh, do not edit */"
+	print ""
+	print "static const struct id_index_entry id_embedded_entries[] = {"
+	pos = 1
+}
+{
+	split($1, k, " ")
+	if (k[1] k[2] k[3] == last)
+		next
+	last = k[1] k[2] k[3]
+	printf "  { 0x%s, 0x%s, %s, %d },\n", k[2], k[3], k[1], pos
+	name = $2
+	gsub(/\\/, "\\\\\\\\", name)
+	gsub(/"/, "\\\"", name)
+	gsub(/\?/, "\\?", name)
+	names[n++] = name
+	pos += length($2) + 1
+}
+END {
+	print "};"
+	print ""
+	print "static const char id_embedded_names[] ="
+	print "  \"\\0\""
+	for (i=0; i<n; i++)
+		print "  \"" names[i] "\\0\""
+	print "  ;"
+}
+'
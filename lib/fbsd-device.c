@@ -359,5 +359,6 @@ struct pci_methods pm_fbsd_device = {
   fbsd_write,
   NULL,                                 /* read_vpd */
   NULL,                                 /* dev_init */
-  NULL                                  /* dev_cleanup */
+  NULL,                                 /* dev_cleanup */
+  NULL                                  /* read_batch */
 };
@@ -0,0 +1,185 @@
+/*
+ *	The PCI Library -- Pool of Open Device Files
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <unistd.h>
+
+#include "internal.h"
+
+/*
+ *  Back-ends which access the config space through per-device files keep
+ *  the files open in a bounded pool, so that programs interleaving accesses
+ *  to several devices need not reopen them all the time. The pool is a list
+ *  ordered by the time of the last use; when it is full, the least recently
+ *  used file is closed. Each device also chains its own files, so lookups
+ *  do not depend on the size of the pool.
+ */
+
+struct pci_fd {
+  struct pci_fd *prev, *next;		/* LRU list, the most recent first */
+  struct pci_fd *dev_next;		/* Other files of the same device */
+  struct pci_dev *dev;
+  int kind;				/* PCI_FD_xxx */
+  int rw;				/* Opened read-write */
+  int fd;
+};
+
+struct pci_fd_pool {
+  struct pci_fd head;			/* Sentinel of the LRU list */
+  int num_fds, max_fds;
+  unsigned int hits, misses, evictions;
+};
+
+void
+pci_fd_pool_init(struct pci_access *a, int size)
+{
+  struct pci_fd_pool *p = pci_malloc(a, sizeof(*p));
+
+  if (size < 1)
+    size = 1;
+  p->head.prev = p->head.next = &p->head;
+  p->num_fds = 0;
+  p->max_fds = size;
+  p->hits = p->misses = p->evictions = 0;
+  a->fd_pool = p;
+  a->fd = -1;
+}
+
+static void
+pci_fd_unlink(struct pci_access *a, struct pci_fd *f)
+{
+  struct pci_fd **pf;
+
+  f->prev->next = f->next;
+  f->next->prev = f->prev;
+  for (pf = &f->dev->fds; *pf != f; pf = &(*pf)->dev_next)
+    ;
+  *pf = f->dev_next;
+  close(f->fd);
+  /* The position remembered by the read/write glue is no longer valid */
+  if (a->fd == f->fd)
+    a->fd = -1;
+  a->fd_pool->num_fds--;
+}
+
+/* Returns an open file of the device if there is one good enough, else -1 */
+int
+pci_fd_find(struct pci_dev *d, int kind, int rw)
+{
+  struct pci_fd_pool *p = d->access->fd_pool;
+  struct pci_fd *f;
+
+  for (f = d->fds; f; f = f->dev_next)
+    if (f->kind == kind && f->rw >= rw)
+      {
+	p->hits++;
+	if (p->head.next != f)
+	  {
+	    f->prev->next = f->next;
+	    f->next->prev = f->prev;
+	    f->next = p->head.next;
+	    f->prev = &p->head;
+	    f->next->prev = f;
+	    p->head.next = f;
+	  }
+	return f->fd;
+      }
+  p->misses++;
+  return -1;
+}
+
+/* Puts a newly opened file to the pool, replacing the previous one of the same kind */
+void
+pci_fd_add(struct pci_dev *d, int kind, int rw, int fd)
+{
+  struct pci_access *a = d->access;
+  struct pci_fd_pool *p = a->fd_pool;
+  struct pci_fd *f;
+
+  for (f = d->fds; f; f = f->dev_next)
+    if (f->kind == kind)
+      {
+	/* A read-only file is replaced by a read-write one */
+	pci_fd_unlink(a, f);
+	break;
+      }
+  if (!f && p->num_fds >= p->max_fds)
+    {
+      f = p->head.prev;
+      pci_fd_unlink(a, f);
+      p->evictions++;
+    }
+  if (!f)
+    f = pci_malloc(a, sizeof(*f));
+  f->dev = d;
+  f->kind = kind;
+  f->rw = rw;
+  f->fd = fd;
+  f->dev_next = d->fds;
+  d->fds = f;
+  if (kind == PCI_FD_DIR)
+    {
+      /* Directories serve only for opening other files, so they are evicted first unless used again */
+      f->prev = p->head.prev;
+      f->next = &p->head;
+      f->prev->next = f;
+      p->head.prev = f;
+    }
+  else
+    {
+      f->next = p->head.next;
+      f->prev = &p->head;
+      f->next->prev = f;
+      p->head.next = f;
+    }
+  p->num_fds++;
+}
+
+int
+pci_fd_get(struct pci_dev *d, int kind, int rw, int (*open_fd)(struct pci_dev *d, int kind, int rw))
+{
+  int fd = pci_fd_find(d, kind, rw);
+
+  if (fd < 0)
+    {
+      fd = open_fd(d, kind, rw);
+      if (fd >= 0)
+	pci_fd_add(d, kind, rw, fd);
+    }
+  return fd;
+}
+
+void
+pci_fd_close_dev(struct pci_dev *d)
+{
+  struct pci_fd *f;
+
+  while (f = d->fds)
+    {
+      pci_fd_unlink(d->access, f);
+      pci_mfree(f);
+    }
+}
+
+void
+pci_fd_pool_cleanup(struct pci_access *a)
+{
+  struct pci_fd_pool *p = a->fd_pool;
+
+  if (!p)
+    return;
+  while (p->head.next != &p->head)
+    {
+      struct pci_fd *f = p->head.next;
+      pci_fd_unlink(a, f);
+      pci_mfree(f);
+    }
+  if (p->hits || p->misses)
+    a->debug("File pool: %u hits, %u misses, %u evictions\n", p->hits, p->misses, p->evictions);
+  pci_mfree(p);
+  a->fd_pool = NULL;
+}
@@ -79,7 +79,7 @@ pci_generic_fill_info(struct pci_dev *d, int flags)
 {
   struct pci_access *a = d->access;
 
-  if ((flags & (PCI_FILL_BASES | PCI_FILL_ROM_BASE)) && d->hdrtype < 0)
+  if ((flags & (PCI_FILL_BASES | PCI_FILL_ROM_BASE | PCI_FILL_SUBSYS)) && d->hdrtype < 0)
     d->hdrtype = pci_read_byte(d, PCI_HEADER_TYPE) & 0x7f;
   if (flags & PCI_FILL_IDENT)
     {
@@ -157,6 +157,22 @@ pci_generic_fill_info(struct pci_dev *d, int flags)
 	    d->rom_base_addr = u;
 	}
     }
+  if (flags & PCI_FILL_SUBSYS)
+    {
+      switch (d->hdrtype)
+	{
+	case PCI_HEADER_TYPE_NORMAL:
+	  d->subsys_vendor_id = pci_read_word(d, PCI_SUBSYSTEM_VENDOR_ID);
+	  d->subsys_id = pci_read_word(d, PCI_SUBSYSTEM_ID);
+	  break;
+	case PCI_HEADER_TYPE_CARDBUS:
+	  d->subsys_vendor_id = pci_read_word(d, PCI_CB_SUBSYSTEM_VENDOR_ID);
+	  d->subsys_id = pci_read_word(d, PCI_CB_SUBSYSTEM_ID);
+	  break;
+	default:
+	  d->subsys_vendor_id = d->subsys_id = 0xffff;
+	}
+    }
   if (flags & (PCI_FILL_CAPS | PCI_FILL_EXT_CAPS))
     flags |= pci_scan_caps(d, flags);
   return flags & ~PCI_FILL_SIZES;
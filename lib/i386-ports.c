@@ -294,7 +294,8 @@ struct pci_methods pm_intel_conf1 = {
   conf1_write,
   NULL,					/* read_vpd */
   NULL,					/* init_dev */
-  NULL					/* cleanup_dev */
+  NULL,					/* cleanup_dev */
+  NULL					/* read_batch */
 };
 
 struct pci_methods pm_intel_conf2 = {
@@ -310,5 +311,6 @@ struct pci_methods pm_intel_conf2 = {
   conf2_write,
   NULL,					/* read_vpd */
   NULL,					/* init_dev */
-  NULL					/* cleanup_dev */
+  NULL,					/* cleanup_dev */
+  NULL					/* read_batch */
 };
@@ -182,13 +182,24 @@ pci_alloc(void)
 
   memset(a, 0, sizeof(*a));
   pci_set_name_list_path(a, PCI_PATH_IDS_DIR "/" PCI_IDS, 0);
+  pci_id_db_init(a);
+  pci_define_param(a, "names.lazy", "0", "Parse only the parts of the ID list which are needed");
+#ifdef PCI_HAVE_SHM
+  pci_define_param(a, "names.shm", "0", "Share the parsed ID list with other processes via shared memory");
+#endif
 #ifdef PCI_USE_DNS
   pci_define_param(a, "net.domain", PCI_ID_DOMAIN, "DNS domain used for resolving of ID's");
   pci_define_param(a, "net.cache_name", "~/.pciids-cache", "Name of the ID cache file");
+  pci_define_param(a, "net.negative_ttl", "86400", "How long to remember ID's unknown to the DNS (in seconds)");
+  pci_define_param(a, "net.server", "", "DNS server used for batch resolving (default: from resolv.conf)");
+  pci_define_param(a, "net.port", "53", "Port of the DNS server");
+  pci_define_param(a, "net.parallel", "16", "Maximum number of DNS queries in flight");
+  pci_define_param(a, "net.timeout", "2000", "Timeout of a single DNS query in milliseconds");
   a->id_lookup_mode = PCI_LOOKUP_CACHE;
 #endif
 #ifdef PCI_HAVE_HWDB
   pci_define_param(a, "hwdb.disable", "0", "Do not look up names in UDEV's HWDB if non-zero");
+  pci_define_param(a, "hwdb.preload", "1", "Query the HWDB for all names needed by a batch lookup at once");
 #endif
   for (i=0; i<PCI_ACCESS_MAX; i++)
     if (pci_methods[i] && pci_methods[i]->config)
@@ -256,7 +267,7 @@ pci_cleanup(struct pci_access *a)
     }
   if (a->methods)
     a->methods->cleanup(a);
-  pci_free_name_list(a);
+  pci_id_db_cleanup(a);
   pci_free_params(a);
   pci_set_name_list_path(a, NULL, 0);
   pci_mfree(a);
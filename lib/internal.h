@@ -47,6 +47,7 @@ struct pci_methods {
   int (*read_vpd)(struct pci_dev *, int pos, byte *buf, int len);
   void (*init_dev)(struct pci_dev *);
   void (*cleanup_dev)(struct pci_dev *);
+  void (*read_batch)(struct pci_access *, struct pci_read_request *reqs, int n);
 };
 
 /* generic.c */
@@ -74,6 +75,7 @@ int pci_fill_info_v32(struct pci_dev *, int flags) VERSIONED_ABI;
 int pci_fill_info_v33(struct pci_dev *, int flags) VERSIONED_ABI;
 int pci_fill_info_v34(struct pci_dev *, int flags) VERSIONED_ABI;
 int pci_fill_info_v35(struct pci_dev *, int flags) VERSIONED_ABI;
+int pci_fill_info_v37(struct pci_dev *, int flags) VERSIONED_ABI;
 
 struct pci_property {
   struct pci_property *next;
@@ -83,11 +85,34 @@ struct pci_property {
 
 char *pci_set_property(struct pci_dev *d, u32 key, char *value);
 
+/* names-parse.c */
+void pci_id_db_init(struct pci_access *a);
+void pci_id_db_cleanup(struct pci_access *a);
+
 /* params.c */
 void pci_define_param(struct pci_access *acc, char *param, char *val, char *help);
 int pci_set_param_internal(struct pci_access *acc, char *param, char *val, int copy);
 void pci_free_params(struct pci_access *acc);
 
+/* fdpool.c */
+enum { PCI_FD_CONFIG, PCI_FD_VPD, PCI_FD_DIR };
+void pci_fd_pool_init(struct pci_access *a, int size);
+void pci_fd_pool_cleanup(struct pci_access *a);
+int pci_fd_find(struct pci_dev *d, int kind, int rw);
+void pci_fd_add(struct pci_dev *d, int kind, int rw, int fd);
+int pci_fd_get(struct pci_dev *d, int kind, int rw, int (*open_fd)(struct pci_dev *d, int kind, int rw));
+void pci_fd_close_dev(struct pci_dev *d);
+
+#ifdef PCI_HAVE_IO_URING
+/* io-uring.c */
+struct pci_uring *pci_uring_open(struct pci_access *a, unsigned int entries);
+void pci_uring_close(struct pci_uring *r);
+unsigned int pci_uring_entries(struct pci_uring *r);
+void pci_uring_openat(struct pci_uring *r, int dir_fd, const char *name, int flags, u64 user_data);
+void pci_uring_pread(struct pci_uring *r, int fd, void *buf, unsigned int len, u64 pos, u64 user_data);
+int pci_uring_wait(struct pci_uring *r, void (*done)(void *data, u64 user_data, int res), void *data);
+#endif
+
 /* caps.c */
 unsigned int pci_scan_caps(struct pci_dev *, unsigned int want_fields);
 void pci_free_caps(struct pci_dev *);
@@ -0,0 +1,212 @@
+/*
+ *	The PCI Library -- Batched I/O via io_uring on Linux
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "internal.h"
+
+/*
+ *  A minimal io_uring without liburing: operations are queued to the
+ *  submission ring and pci_uring_wait() submits all of them and waits
+ *  for all completions in a single system call (unless interrupted).
+ *  The caller must not queue more operations than the ring has entries.
+ */
+
+struct pci_uring {
+  struct pci_access *access;
+  int fd;
+  unsigned int entries, queued;
+  unsigned int *sq_tail, *sq_mask, *sq_array;
+  unsigned int *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_len, cq_len, sqes_len;
+};
+
+struct pci_uring *
+pci_uring_open(struct pci_access *a, unsigned int entries)
+{
+  struct pci_uring *r;
+  struct io_uring_params p;
+  int fd;
+
+  memset(&p, 0, sizeof(p));
+  fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0)
+    {
+      a->debug("io_uring not available: %s\n", strerror(errno));
+      return NULL;
+    }
+
+  r = pci_malloc(a, sizeof(*r));
+  memset(r, 0, sizeof(*r));
+  r->access = a;
+  r->fd = fd;
+  r->entries = p.sq_entries;
+  r->sq_len = p.sq_off.array + p.sq_entries * sizeof(u32);
+  r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (r->cq_len > r->sq_len)
+	r->sq_len = r->cq_len;
+      r->cq_len = 0;
+    }
+
+  r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (r->sq_map == MAP_FAILED)
+    goto fail_sq;
+  if (r->cq_len)
+    {
+      r->cq_map = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (r->cq_map == MAP_FAILED)
+	goto fail_cq;
+    }
+  else
+    r->cq_map = r->sq_map;
+  r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED)
+    goto fail_sqes;
+
+  r->sq_tail = (unsigned int *) ((char *) r->sq_map + p.sq_off.tail);
+  r->sq_mask = (unsigned int *) ((char *) r->sq_map + p.sq_off.ring_mask);
+  r->sq_array = (unsigned int *) ((char *) r->sq_map + p.sq_off.array);
+  r->cq_head = (unsigned int *) ((char *) r->cq_map + p.cq_off.head);
+  r->cq_tail = (unsigned int *) ((char *) r->cq_map + p.cq_off.tail);
+  r->cq_mask = (unsigned int *) ((char *) r->cq_map + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *) ((char *) r->cq_map + p.cq_off.cqes);
+  return r;
+
+fail_sqes:
+  if (r->cq_len)
+    munmap(r->cq_map, r->cq_len);
+fail_cq:
+  munmap(r->sq_map, r->sq_len);
+fail_sq:
+  a->debug("Cannot map io_uring: %s\n", strerror(errno));
+  close(fd);
+  pci_mfree(r);
+  return NULL;
+}
+
+void
+pci_uring_close(struct pci_uring *r)
+{
+  munmap(r->sqes, r->sqes_len);
+  if (r->cq_len)
+    munmap(r->cq_map, r->cq_len);
+  munmap(r->sq_map, r->sq_len);
+  close(r->fd);
+  pci_mfree(r);
+}
+
+unsigned int
+pci_uring_entries(struct pci_uring *r)
+{
+  return r->entries;
+}
+
+static struct io_uring_sqe *
+pci_uring_sqe(struct pci_uring *r, int op, int fd, u64 user_data)
+{
+  unsigned int tail = *r->sq_tail, i = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[i];
+
+  if (r->queued >= r->entries)
+    r->access->error("io_uring: too many operations queued");
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->fd = fd;
+  sqe->user_data = user_data;
+  r->sq_array[i] = i;
+  /* The kernel must see the entry before the new tail */
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->queued++;
+  return sqe;
+}
+
+void
+pci_uring_openat(struct pci_uring *r, int dir_fd, const char *name, int flags, u64 user_data)
+{
+  struct io_uring_sqe *sqe = pci_uring_sqe(r, IORING_OP_OPENAT, dir_fd, user_data);
+
+  sqe->addr = (unsigned long) name;
+  sqe->open_flags = flags;
+}
+
+void
+pci_uring_pread(struct pci_uring *r, int fd, void *buf, unsigned int len, u64 pos, u64 user_data)
+{
+  struct io_uring_sqe *sqe = pci_uring_sqe(r, IORING_OP_READ, fd, user_data);
+
+  sqe->addr = (unsigned long) buf;
+  sqe->len = len;
+  sqe->off = pos;
+}
+
+/*
+ *  Passes all completions to the callback. If submission fails, the operations
+ *  not submitted yet are dropped, but we still wait for all the submitted ones,
+ *  as they may write to the caller's buffers or return new file descriptors.
+ *  Returns 0 if anything was dropped.
+ */
+int
+pci_uring_wait(struct pci_uring *r, void (*done)(void *data, u64 user_data, int res), void *data)
+{
+  unsigned int to_submit = r->queued, pending = r->queued;
+  int ok = 1;
+
+  while (pending)
+    {
+      unsigned int head, tail;
+      int n = syscall(__NR_io_uring_enter, r->fd, to_submit, pending, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (n >= 0)
+	to_submit -= n;
+      else if (errno != EINTR)
+	{
+	  if (ok)
+	    r->access->warning("io_uring_enter failed: %s", strerror(errno));
+	  ok = 0;
+	  if (to_submit)
+	    {
+	      /* The kernel has not consumed them, so we can take them back */
+	      __atomic_store_n(r->sq_tail, *r->sq_tail - to_submit, __ATOMIC_RELEASE);
+	      pending -= to_submit;
+	      to_submit = 0;
+	    }
+	  else
+	    {
+	      /* Cannot even wait, so poll for the completions */
+	      struct timespec ts = { 0, 1000000 };
+	      nanosleep(&ts, NULL);
+	    }
+	}
+
+      head = *r->cq_head;
+      tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+      while (head != tail)
+	{
+	  struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+	  done(data, cqe->user_data, cqe->res);
+	  head++;
+	  pending--;
+	}
+      __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+  r->queued = 0;
+  return ok;
+}
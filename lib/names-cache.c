@@ -15,11 +15,49 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <pwd.h>
 #include <unistd.h>
 
-static const char cache_version[] = "#PCI-CACHE-1.0";
+#ifdef PCI_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ *  The cache is a binary file consisting of a header followed by a sequence
+ *  of records, each of them followed by the name padded to a multiple of 4
+ *  bytes. Names of negative entries are empty. New records are appended at
+ *  the end and later records override earlier ones; once there are too many
+ *  expired or overridden records, the whole file is rewritten. All numbers
+ *  are stored in the native byte order.
+ */
+
+#define ID_CACHE_MAGIC 0x68636970	/* "pich" in little endian */
+#define ID_CACHE_VERSION 2
+
+struct id_cache_header {
+  u32 magic;
+  u32 version;
+  u64 ids_size;				/* Size of the ID file the cache was made for */
+  u64 ids_mtime;			/* ... and its modification time */
+};
+
+struct id_cache_record {
+  u32 id12, id34;
+  u32 expires;				/* Expiry time, 0 if never */
+  byte cat;
+  byte reserved;
+  u16 len;				/* Length of the name */
+};
+
+#define CACHE_RECORD_SIZE(len) (sizeof(struct id_cache_record) + (((len) + 3) & ~3))
 
 static char *get_cache_name(struct pci_access *a)
 {
@@ -43,15 +81,126 @@ static char *get_cache_name(struct pci_access *a)
   return pci_get_param(a, "net.cache_name");
 }
 
+/* Names resolved via DNS are useful only for ID's not present in the ID file */
+static void
+cache_header(struct pci_access *a, struct id_cache_header *h)
+{
+  struct stat st;
+
+  memset(h, 0, sizeof(*h));
+  h->magic = ID_CACHE_MAGIC;
+  h->version = ID_CACHE_VERSION;
+  if (stat(a->id_file_name, &st) >= 0)
+    {
+      h->ids_size = st.st_size;
+      h->ids_mtime = st.st_mtime;
+    }
+}
+
+static byte *
+cache_map(struct pci_access *a, int fd, size_t size, int *mapped)
+{
+  byte *data;
+  size_t pos;
+  int n;
+
+#ifdef PCI_HAVE_MMAP
+  data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data != MAP_FAILED)
+    {
+      *mapped = 1;
+      return data;
+    }
+#endif
+
+  *mapped = 0;
+  data = pci_malloc(a, size);
+  for (pos = 0; pos < size; pos += n)
+    {
+      n = read(fd, data + pos, size - pos);
+      if (n <= 0)
+	{
+	  pci_mfree(data);
+	  return NULL;
+	}
+    }
+  return data;
+}
+
+static void
+cache_unmap(byte *data, size_t size UNUSED, int mapped UNUSED)
+{
+#ifdef PCI_HAVE_MMAP
+  if (mapped)
+    {
+      munmap(data, size);
+      return;
+    }
+#endif
+  pci_mfree(data);
+}
+
+/*
+ *  Returns the number of records inserted to the hash, -1 if the file is not usable.
+ *  Sets *damaged if the file has to be rewritten because of a malformed tail.
+ */
+static int
+cache_parse(struct pci_access *a, char *name, byte *data, size_t size, int *total, int *damaged)
+{
+  struct id_cache_header h, *fh = (struct id_cache_header *) data;
+  struct id_cache_record r;
+  char buf[65536];
+  size_t pos;
+  u32 now = time(NULL);
+  unsigned int orig_count = a->id_db->hash_count;
+
+  cache_header(a, &h);
+  if (size < sizeof(h) || fh->magic != h.magic || fh->version != h.version)
+    {
+      a->debug("Unrecognized cache format, ignoring\n");
+      return -1;
+    }
+  if (fh->ids_size != h.ids_size || fh->ids_mtime != h.ids_mtime)
+    {
+      a->debug("Cache was made for a different version of %s, ignoring\n", a->id_file_name);
+      return -1;
+    }
+
+  *total = 0;
+  *damaged = 0;
+  for (pos = sizeof(h); pos + sizeof(r) <= size; pos += CACHE_RECORD_SIZE(r.len))
+    {
+      memcpy(&r, data + pos, sizeof(r));
+      if (!r.cat || r.cat > ID_PROGIF || pos + CACHE_RECORD_SIZE(r.len) > size)
+	break;
+      (*total)++;
+      if (r.expires && r.expires <= now)
+	continue;
+      memcpy(buf, data + pos + sizeof(r), r.len);
+      buf[r.len] = 0;
+      pci_id_insert_expiring(a, r.cat,
+			     pair_first(r.id12), pair_second(r.id12),
+			     pair_first(r.id34), pair_second(r.id34),
+			     buf, SRC_CACHE, r.expires);
+    }
+  if (pos != size)
+    {
+      a->warning("Malformed cache file %s (offset %d), ignoring the rest", name, (int) pos);
+      *damaged = 1;
+    }
+  return a->id_db->hash_count - orig_count;
+}
+
 int
 pci_id_cache_load(struct pci_access *a, int flags)
 {
   char *name;
-  char line[MAX_LINE];
-  FILE *f;
-  int lino;
+  struct stat st;
+  byte *data = NULL;
+  int fd, mapped = 0, live, total, damaged;
 
-  a->id_cache_status = 1;
+  ID_STORE(a->id_db->cache_status, 1);
+  a->id_db->cache_rewrite = 1;
   name = get_cache_name(a);
   if (!name)
     return 0;
@@ -59,121 +208,164 @@ pci_id_cache_load(struct pci_access *a, int flags)
   if (flags & PCI_LOOKUP_REFRESH_CACHE)
     {
       a->debug("Not loading cache, will refresh everything\n");
-      a->id_cache_status = 2;
+      ID_STORE(a->id_db->cache_status, 2);
       return 0;
     }
 
-  f = fopen(name, "rb");
-  if (!f)
+  fd = open(name, O_RDONLY | O_BINARY);
+  if (fd < 0)
     {
       a->debug("Cache file does not exist\n");
       return 0;
     }
-  /* FIXME: Compare timestamp with the pci.ids file? */
-
-  lino = 0;
-  while (fgets(line, sizeof(line), f))
-    {
-      char *p = strchr(line, '\n');
-      lino++;
-      if (p)
-        {
-	  *p = 0;
-	  if (lino == 1)
-	    {
-	      if (strcmp(line, cache_version))
-	        {
-		  a->debug("Unrecognized cache version %s, ignoring\n", line);
-		  break;
-		}
-	      continue;
-	    }
-	  else
-	    {
-	      int cat, id1, id2, id3, id4, cnt;
-	      if (sscanf(line, "%d%x%x%x%x%n", &cat, &id1, &id2, &id3, &id4, &cnt) >= 5)
-	        {
-		  p = line + cnt;
-		  while (*p && *p == ' ')
-		    p++;
-		  pci_id_insert(a, cat, id1, id2, id3, id4, p, SRC_CACHE);
-		  continue;
-		}
-	    }
-	}
-      a->warning("Malformed cache file %s (line %d), ignoring", name, lino);
-      break;
+  if (fstat(fd, &st) < 0 ||
+      (st.st_size && !(data = cache_map(a, fd, st.st_size, &mapped))))
+    {
+      a->warning("Error while reading %s", name);
+      close(fd);
+      return 0;
+    }
+  close(fd);
+  if (!st.st_size)
+    {
+      /* Treated as missing, so it will be rewritten */
+      a->debug("Cache file is empty\n");
+      return 0;
     }
 
-  if (ferror(f))
-    a->warning("Error while reading %s", name);
-  fclose(f);
+  live = cache_parse(a, name, data, st.st_size, &total, &damaged);
+  cache_unmap(data, st.st_size, mapped);
+  if (live < 0)
+    return 0;
+
+  /* Appending is fine as long as the file is sane and most of the records are still in use */
+  a->debug("Loaded %d of %d cached records\n", live, total);
+  a->id_db->cache_rewrite = damaged || (2*live < total);
   return 1;
 }
 
-void
-pci_id_cache_flush(struct pci_access *a)
+static int
+cache_write_all(int fd, void *buf, size_t len)
+{
+  byte *p = buf;
+  int n;
+
+  while (len)
+    {
+      n = write(fd, p, len);
+      if (n <= 0)
+	return 0;
+      p += n;
+      len -= n;
+    }
+  return 1;
+}
+
+/*
+ *  Collect records for all entries which should be written: either only
+ *  the new ones coming from the network, or the whole contents of the cache.
+ *  Negative entries are written only if we know when they expire.
+ */
+static byte *
+cache_collect(struct pci_access *a, int all, size_t *size)
 {
-  int orig_status = a->id_cache_status;
-  FILE *f;
+  struct id_entry *e;
+  struct id_cache_record r;
   unsigned int h;
-  struct id_entry *e, *e2;
-  char hostname[256], *tmpname, *name;
-  int this_pid;
+  size_t len, pos;
+  byte *buf;
 
-  a->id_cache_status = 0;
-  if (orig_status < 2)
-    return;
-  name = get_cache_name(a);
-  if (!name)
-    return;
+  len = 0;
+  h = 0;
+  while (e = pci_id_walk(a, &h))
+    {
+      if ((e->src == SRC_NET || (all && e->src == SRC_CACHE)) && (e->name[0] || e->expires))
+	len += CACHE_RECORD_SIZE(strlen(e->name));
+    }
+
+  buf = pci_malloc(a, len + 1);
+  pos = 0;
+  h = 0;
+  while (e = pci_id_walk(a, &h))
+    {
+      if ((e->src == SRC_NET || (all && e->src == SRC_CACHE)) && (e->name[0] || e->expires))
+	{
+	  memset(&r, 0, sizeof(r));
+	  r.id12 = e->id12;
+	  r.id34 = e->id34;
+	  r.expires = e->expires;
+	  r.cat = e->cat;
+	  r.len = strlen(e->name);
+	  memcpy(buf + pos, &r, sizeof(r));
+	  memset(buf + pos + sizeof(r), 0, CACHE_RECORD_SIZE(r.len) - sizeof(r));
+	  memcpy(buf + pos + sizeof(r), e->name, r.len);
+	  pos += CACHE_RECORD_SIZE(r.len);
+	}
+    }
+  *size = pos;
+  return buf;
+}
+
+/* Append new records by a single write, so that concurrent writers do not mix */
+static int
+cache_append(struct pci_access *a, char *name)
+{
+  byte *buf;
+  size_t size;
+  int fd, ok;
+
+  fd = open(name, O_WRONLY | O_APPEND | O_BINARY);
+  if (fd < 0)
+    return 0;
+  buf = cache_collect(a, 0, &size);
+  a->debug("Appending %d bytes to cache %s\n", (int) size, name);
+  ok = (write(fd, buf, size) == (int) size);
+  if (close(fd) < 0)
+    ok = 0;
+  if (!ok)
+    a->debug("Appending failed, rewriting the whole cache\n");
+  pci_mfree(buf);
+  return ok;
+}
+
+static void
+cache_rewrite(struct pci_access *a, char *name)
+{
+  struct id_cache_header hdr;
+  char hostname[256], *tmpname;
+  byte *buf;
+  size_t size;
+  int fd, ok;
 
-  this_pid = getpid();
   if (gethostname(hostname, sizeof(hostname)) < 0)
     hostname[0] = 0;
   else
     hostname[sizeof(hostname)-1] = 0;
   tmpname = pci_malloc(a, strlen(name) + strlen(hostname) + 64);
-  sprintf(tmpname, "%s.tmp-%s-%d", name, hostname, this_pid);
+  sprintf(tmpname, "%s.tmp-%s-%d", name, hostname, (int) getpid());
 
-  f = fopen(tmpname, "wb");
-  if (!f)
+  fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+  if (fd < 0)
     {
       a->warning("Cannot write to %s: %s", name, strerror(errno));
       pci_mfree(tmpname);
       return;
     }
   a->debug("Writing cache to %s\n", name);
-  fprintf(f, "%s\n", cache_version);
 
-  for (h=0; h<HASH_SIZE; h++)
-    for (e=a->id_hash[h]; e; e=e->next)
-      if (e->src == SRC_CACHE || e->src == SRC_NET)
-	{
-	  /* Negative entries are not written */
-	  if (!e->name[0])
-	    continue;
-
-	  /* Verify that every entry is written at most once */
-	  for (e2=a->id_hash[h]; e2 != e; e2=e2->next)
-	    if ((e2->src == SRC_CACHE || e2->src == SRC_NET) &&
-	        e2->cat == e->cat &&
-		e2->id12 == e->id12 && e2->id34 == e->id34)
-	    break;
-	  if (e2 == e)
-	    fprintf(f, "%d %x %x %x %x %s\n",
-	            e->cat,
-		    pair_first(e->id12), pair_second(e->id12),
-		    pair_first(e->id34), pair_second(e->id34),
-		    e->name);
-	}
-
-  fflush(f);
-  if (ferror(f))
-    a->warning("Error writing %s", name);
-  fclose(f);
+  cache_header(a, &hdr);
+  buf = cache_collect(a, 1, &size);
+  ok = cache_write_all(fd, &hdr, sizeof(hdr)) && cache_write_all(fd, buf, size);
+  if (close(fd) < 0)
+    ok = 0;
+  pci_mfree(buf);
 
-  if (rename(tmpname, name) < 0)
+  if (!ok)
+    {
+      a->warning("Error writing %s", name);
+      unlink(tmpname);
+    }
+  else if (rename(tmpname, name) < 0)
     {
       a->warning("Cannot rename %s to %s: %s", tmpname, name, strerror(errno));
       unlink(tmpname);
@@ -181,17 +373,34 @@ pci_id_cache_flush(struct pci_access *a)
   pci_mfree(tmpname);
 }
 
+void
+pci_id_cache_flush(struct pci_access *a)
+{
+  int orig_status = a->id_db->cache_status;
+  char *name;
+
+  ID_STORE(a->id_db->cache_status, 0);
+  if (orig_status < 2)
+    return;
+  name = get_cache_name(a);
+  if (!name)
+    return;
+
+  if (a->id_db->cache_rewrite || !cache_append(a, name))
+    cache_rewrite(a, name);
+}
+
 #else
 
 int pci_id_cache_load(struct pci_access *a UNUSED, int flags UNUSED)
 {
-  a->id_cache_status = 1;
+  ID_STORE(a->id_db->cache_status, 1);
   return 0;
 }
 
 void pci_id_cache_flush(struct pci_access *a)
 {
-  a->id_cache_status = 0;
+  ID_STORE(a->id_db->cache_status, 0);
 }
 
 #endif
@@ -199,6 +408,6 @@ void pci_id_cache_flush(struct pci_access *a)
 void
 pci_id_cache_dirty(struct pci_access *a)
 {
-  if (a->id_cache_status >= 1)
-    a->id_cache_status = 2;
+  if (a->id_db->cache_status >= 1)
+    ID_STORE(a->id_db->cache_status, 2);
 }
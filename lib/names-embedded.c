@@ -0,0 +1,69 @@
+/*
+ *	The PCI Library -- ID List Linked into the Library
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include "internal.h"
+#include "names.h"
+
+#ifdef PCI_HAVE_EMBEDDED_IDS
+
+/*
+ *  The tables are generated from the ID list at build time by embed-ids.sh
+ *  (possibly only for selected vendors and classes). They use the layout
+ *  of the binary index: entries sorted by (cat, id12, id34) and offsets
+ *  to a pool of names.
+ */
+
+#include "ids-embedded.h"
+
+#define NUM_EMBEDDED (sizeof(id_embedded_entries) / sizeof(id_embedded_entries[0]))
+
+char *
+pci_id_embedded_lookup(int cat, int id1, int id2, int id3, int id4)
+{
+  u32 id12 = id_pair(id1, id2), id34 = id_pair(id3, id4);
+  unsigned int l = 0, r = NUM_EMBEDDED;
+
+  while (l < r)
+    {
+      unsigned int m = (l + r) / 2;
+      const struct id_index_entry *e = &id_embedded_entries[m];
+      if (e->cat == (u32) cat && e->id12 == id12 && e->id34 == id34)
+	return (char *) id_embedded_names + e->name;
+      if (e->cat < (u32) cat || (e->cat == (u32) cat && (e->id12 < id12 || (e->id12 == id12 && e->id34 < id34))))
+	l = m + 1;
+      else
+	r = m;
+    }
+  return NULL;
+}
+
+const struct id_index_entry *
+pci_id_embedded_entries(u32 *num, const char **names)
+{
+  *num = NUM_EMBEDDED;
+  *names = id_embedded_names;
+  return id_embedded_entries;
+}
+
+#else
+
+char *
+pci_id_embedded_lookup(int cat UNUSED, int id1 UNUSED, int id2 UNUSED, int id3 UNUSED, int id4 UNUSED)
+{
+  return NULL;
+}
+
+const struct id_index_entry *
+pci_id_embedded_entries(u32 *num, const char **names)
+{
+  *num = 0;
+  *names = NULL;
+  return NULL;
+}
+
+#endif
@@ -29,20 +29,14 @@ union id_align {
 
 static void *id_alloc(struct pci_access *a, unsigned int size)
 {
-  struct id_bucket *buck = a->current_id_bucket;
+  struct id_bucket *buck = a->id_db->current_bucket;
   unsigned int pos;
 
-  if (!a->id_hash)
-    {
-      a->id_hash = pci_malloc(a, sizeof(struct id_entry *) * HASH_SIZE);
-      memset(a->id_hash, 0, sizeof(struct id_entry *) * HASH_SIZE);
-    }
-
   if (!buck || buck->full + size > BUCKET_SIZE)
     {
       buck = pci_malloc(a, BUCKET_SIZE);
-      buck->next = a->current_id_bucket;
-      a->current_id_bucket = buck;
+      buck->next = a->id_db->current_bucket;
+      a->id_db->current_bucket = buck;
       buck->full = BUCKET_ALIGN(sizeof(struct id_bucket));
     }
   pos = buck->full;
@@ -50,79 +44,683 @@ static void *id_alloc(struct pci_access *a, unsigned int size)
   return (byte *)buck + pos;
 }
 
-static inline unsigned int id_hash(int cat, u32 id12, u32 id34)
+/*
+ *  Names are interned: many entries (especially subsystems) share the same
+ *  name, so we store each distinct string only once. The pool is an open-addressing
+ *  hash table of pointers to strings allocated by id_alloc(), at most 3/4 full.
+ *  Each slot also has 16 bits of the hash, so that probing rarely needs to look
+ *  at the strings themselves. The table is needed only while a batch of entries
+ *  is being inserted, so it is dropped after each load of the ID list; later
+ *  insertions start a new one.
+ */
+
+struct id_strings {
+  char **slots;
+  u16 *tags;				/* Upper halves of hashes of the slots */
+  unsigned int size, used;		/* Of the current table */
+  unsigned int count;			/* Distinct names interned */
+  unsigned int saved;			/* Number of bytes saved by sharing */
+  unsigned int table_bytes;		/* Largest size of the table */
+};
+
+/* Takes 4 bytes at a time, as the names are hashed many times during loading */
+static inline unsigned int id_string_hash(const char *s, unsigned int len)
+{
+  u32 h = len, w;
+
+  while (len >= 4)
+    {
+      memcpy(&w, s, 4);
+      h = (h ^ w) * 0x9e3779b1U;
+      h ^= h >> 15;
+      s += 4;
+      len -= 4;
+    }
+  while (len--)
+    h = (h ^ (byte) *s++) * 16777619U;
+  return h ^ (h >> 16);
+}
+
+/* Returns the slot of the string, or the empty slot where it belongs */
+static unsigned int
+id_string_find(struct id_strings *p, const char *s, unsigned int hash)
+{
+  unsigned int mask = p->size - 1;
+  unsigned int h = hash & mask;
+  u16 tag = hash >> 16;
+
+  while (p->slots[h] && (p->tags[h] != tag || strcmp(p->slots[h], s)))
+    h = (h + 1) & mask;
+  return h;
+}
+
+static void
+id_strings_resize(struct pci_access *a, unsigned int size)
+{
+  struct id_strings *p = a->id_db->strings;
+  char **old = p->slots;
+  unsigned int old_size = p->size;
+  unsigned int i, hash, h, bytes = (sizeof(char *) + sizeof(u16)) * size;
+
+  p->slots = pci_malloc(a, bytes);
+  memset(p->slots, 0, bytes);
+  p->tags = (u16 *) (p->slots + size);
+  p->size = size;
+  if (bytes > p->table_bytes)
+    p->table_bytes = bytes;
+  for (i=0; i<old_size; i++)
+    if (old[i])
+      {
+	hash = id_string_hash(old[i], strlen(old[i]));
+	h = id_string_find(p, old[i], hash);
+	p->slots[h] = old[i];
+	p->tags[h] = hash >> 16;
+      }
+  pci_mfree(old);
+}
+
+static char *
+id_intern(struct pci_access *a, const char *s)
+{
+  struct id_strings *p = a->id_db->strings;
+  unsigned int hash, h;
+  int len;
+
+  if (!p)
+    {
+      p = a->id_db->strings = pci_malloc(a, sizeof(*p));
+      memset(p, 0, sizeof(*p));
+    }
+  if (!p->slots)
+    id_strings_resize(a, HASH_INITIAL_SIZE);
+  else if (4 * (p->used + 1) > 3 * p->size)
+    id_strings_resize(a, 2 * p->size);
+
+  len = strlen(s) + 1;
+  hash = id_string_hash(s, len - 1);
+  h = id_string_find(p, s, hash);
+  if (p->slots[h])
+    {
+      p->saved += len;
+      return p->slots[h];
+    }
+  p->slots[h] = id_alloc(a, len);
+  p->tags[h] = hash >> 16;
+  memcpy(p->slots[h], s, len);
+  p->used++;
+  p->count++;
+  return p->slots[h];
+}
+
+/* Forgets the table of interned names, keeping the names themselves */
+void
+pci_id_strings_drop(struct pci_access *a)
+{
+  struct id_strings *p = a->id_db->strings;
+
+  if (p)
+    {
+      pci_mfree(p->slots);
+      p->slots = NULL;
+      p->size = p->used = 0;
+    }
+}
+
+void
+pci_id_strings_stats(struct pci_access *a)
+{
+  struct id_strings *p = a->id_db->strings;
+
+  if (p)
+    a->debug("Interned %u distinct names, %u bytes saved (%d net of the %u bytes of the temporary table)\n",
+	     p->count, p->saved, (int) p->saved - (int) p->table_bytes, p->table_bytes);
+}
+
+/*
+ *  Thread safety: all modifications of the database are serialized by a mutex,
+ *  but once the ID list is loaded, lookups of the hash do not lock. Instead,
+ *  the writer makes the sequence number odd while it modifies the hash and
+ *  readers retry if it has changed during their lookup (a seqlock). Hash
+ *  tables replaced by a resize are kept until the whole hash is freed, since
+ *  a reader can still be probing them; names are never freed before that
+ *  either, so the pointers returned to the readers stay valid.
+ */
+
+#ifdef PCI_HAVE_PTHREAD
+
+void
+pci_id_db_lock_init(struct id_db *db)
+{
+  pthread_mutex_init(&db->lock, NULL);
+}
+
+void
+pci_id_db_lock_cleanup(struct id_db *db)
 {
-  unsigned int h;
+  pthread_mutex_destroy(&db->lock);
+}
 
-  h = id12 ^ (id34 << 3) ^ (cat << 5);
-  return h % HASH_SIZE;
+void
+pci_id_lock(struct pci_access *a)
+{
+  pthread_mutex_lock(&a->id_db->lock);
+}
+
+void
+pci_id_unlock(struct pci_access *a)
+{
+  pthread_mutex_unlock(&a->id_db->lock);
 }
 
 int
-pci_id_insert(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src)
+pci_id_loaded(struct pci_access *a)
+{
+  return __atomic_load_n(&a->id_db->loaded, __ATOMIC_ACQUIRE);
+}
+
+void
+pci_id_set_loaded(struct pci_access *a, int loaded)
+{
+  __atomic_store_n(&a->id_db->loaded, loaded, __ATOMIC_RELEASE);
+}
+
+static inline unsigned int
+id_read_begin(struct id_db *db)
+{
+  unsigned int seq;
+
+  while ((seq = __atomic_load_n(&db->seq, __ATOMIC_ACQUIRE)) & 1)
+    ;
+  return seq;
+}
+
+static inline int
+id_read_retry(struct id_db *db, unsigned int seq)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&db->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void
+id_write_begin(struct id_db *db)
+{
+  __atomic_store_n(&db->seq, db->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+id_write_end(struct id_db *db)
+{
+  __atomic_store_n(&db->seq, db->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ *  As the table doubles on each resize, the retired tables take less space
+ *  than the current one, so we need not limit their number.
+ */
+struct id_old_hash {
+  struct id_old_hash *next;
+  struct id_entry *hash;
+};
+
+static void
+id_hash_retire(struct pci_access *a, struct id_entry *old)
+{
+  struct id_db *db = a->id_db;
+  struct id_old_hash *o;
+
+  if (db->loaded && old)
+    {
+      o = pci_malloc(a, sizeof(*o));
+      o->hash = old;
+      o->next = db->old_hash;
+      db->old_hash = o;
+    }
+  else
+    pci_mfree(old);
+}
+
+static void
+id_hash_free_old(struct id_db *db)
+{
+  struct id_old_hash *o;
+
+  while (o = db->old_hash)
+    {
+      db->old_hash = o->next;
+      pci_mfree(o->hash);
+      pci_mfree(o);
+    }
+}
+
+#else
+
+void pci_id_db_lock_init(struct id_db *db UNUSED) { }
+void pci_id_db_lock_cleanup(struct id_db *db UNUSED) { }
+void pci_id_lock(struct pci_access *a UNUSED) { }
+void pci_id_unlock(struct pci_access *a UNUSED) { }
+int pci_id_loaded(struct pci_access *a) { return a->id_db->loaded; }
+void pci_id_set_loaded(struct pci_access *a, int loaded) { a->id_db->loaded = loaded; }
+
+static inline unsigned int id_read_begin(struct id_db *db UNUSED) { return 0; }
+static inline int id_read_retry(struct id_db *db UNUSED, unsigned int seq UNUSED) { return 0; }
+static inline void id_write_begin(struct id_db *db UNUSED) { }
+static inline void id_write_end(struct id_db *db UNUSED) { }
+static void id_hash_retire(struct pci_access *a UNUSED, struct id_entry *old) { pci_mfree(old); }
+static void id_hash_free_old(struct id_db *db UNUSED) { }
+
+#endif
+
+/*
+ *  The hash table uses open addressing with linear probing. Its size is always
+ *  a power of two and we keep it at most half full. Empty slots have cat == 0
+ *  (ID_UNKNOWN), which is never used for real entries.
+ */
+
+static inline unsigned int id_hash(int cat, u32 id12, u32 id34)
+{
+  u32 h;
+
+  h = id12 * 0x9e3779b1;
+  h ^= (id34 + cat) * 0x85ebca6b;
+  h ^= h >> 15;
+  return h;
+}
+
+static struct id_entry *
+id_hash_find_in(struct id_entry *hash, unsigned int size, int cat, u32 id12, u32 id34)
+{
+  unsigned int mask = size - 1;
+  unsigned int h = id_hash(cat, id12, id34) & mask;
+  struct id_entry *e;
+
+  for (;;)
+    {
+      e = &hash[h];
+      if (!ID_LOAD(e->cat) || (ID_LOAD(e->id12) == id12 && ID_LOAD(e->id34) == id34 && ID_LOAD(e->cat) == cat))
+	return e;
+      h = (h + 1) & mask;
+    }
+}
+
+static inline struct id_entry *
+id_hash_find(struct pci_access *a, int cat, u32 id12, u32 id34)
+{
+  return id_hash_find_in(a->id_db->hash, a->id_db->hash_size, cat, id12, id34);
+}
+
+/*
+ *  Classes, subclasses and programming interfaces are not hashed, but kept
+ *  in dense tables indexed directly by the ID's: a table of all classes,
+ *  a table of subclasses for every class which has any, and a table of
+ *  prog-if's for every such subclass. Tables are allocated inside a write
+ *  section, so lock-free readers which see them half-initialized retry.
+ */
+
+static inline int
+id_dense_p(int cat, u32 id12, u32 id34)
+{
+  switch (cat)
+    {
+    case ID_CLASS:
+      return id12 < 0x1000000 && !(id12 & 0xffff) && !id34;
+    case ID_SUBCLASS:
+      return id12 < 0x1000000 && !(id12 & 0xff00) && !id34;
+    case ID_PROGIF:
+      return id12 < 0x1000000 && !(id12 & 0xff00) && id34 < 0x1000000 && !(id34 & 0xffff);
+    default:
+      return 0;
+    }
+}
+
+static void *
+id_dense_alloc(struct pci_access *a, unsigned int size)
+{
+  void *p = pci_malloc(a, size);
+  memset(p, 0, size);
+  return p;
+}
+
+/* Returns the slot for the ID; if create is not set, NULL when its table does not exist */
+static struct id_entry *
+id_dense_find(struct pci_access *a, int cat, u32 id12, u32 id34, int create)
+{
+  struct id_db *db = a->id_db;
+  struct id_classes *c = ID_LOAD(db->classes);
+  struct id_class_table *t;
+  struct id_entry *p;
+  unsigned int cls = id12 >> 16, sub = id12 & 0xff;
+
+  if (!c)
+    {
+      if (!create)
+	return NULL;
+      c = id_dense_alloc(a, sizeof(struct id_classes));
+      ID_STORE(db->classes, c);
+    }
+  if (cat == ID_CLASS)
+    return &c->classes[cls];
+
+  t = ID_LOAD(c->tables[cls]);
+  if (!t)
+    {
+      if (!create)
+	return NULL;
+      t = id_dense_alloc(a, sizeof(struct id_class_table));
+      ID_STORE(c->tables[cls], t);
+    }
+  if (cat == ID_SUBCLASS)
+    return &t->subclasses[sub];
+
+  p = ID_LOAD(t->progifs[sub]);
+  if (!p)
+    {
+      if (!create)
+	return NULL;
+      p = id_dense_alloc(a, 256 * sizeof(struct id_entry));
+      ID_STORE(t->progifs[sub], p);
+    }
+  return &p[id34 >> 16];
+}
+
+static void
+id_dense_free(struct id_db *db)
+{
+  struct id_classes *c = db->classes;
+  int i, j;
+
+  if (!c)
+    return;
+  for (i=0; i<256; i++)
+    if (c->tables[i])
+      {
+	for (j=0; j<256; j++)
+	  pci_mfree(c->tables[i]->progifs[j]);
+	pci_mfree(c->tables[i]);
+      }
+  pci_mfree(c);
+  db->classes = NULL;
+}
+
+/* Lock-free lookup returning a consistent copy of the entry (cat == 0 if not found) */
+static void
+id_hash_get(struct pci_access *a, int cat, u32 id12, u32 id34, struct id_entry *res)
+{
+  struct id_db *db = a->id_db;
+  struct id_entry *hash, *e;
+  unsigned int seq, size;
+
+  if (id_dense_p(cat, id12, id34))
+    {
+      do
+	{
+	  seq = id_read_begin(db);
+	  e = id_dense_find(a, cat, id12, id34, 0);
+	  res->cat = e ? ID_LOAD(e->cat) : 0;
+	  if (res->cat)
+	    {
+	      res->src = ID_LOAD(e->src);
+	      res->expires = ID_LOAD(e->expires);
+	      res->name = ID_LOAD(e->name);
+	    }
+	}
+      while (id_read_retry(db, seq));
+      return;
+    }
+
+  do
+    {
+      seq = id_read_begin(db);
+      hash = ID_LOAD(db->hash);
+      size = ID_LOAD(db->hash_size);
+      if (id_read_retry(db, seq))
+	continue;
+      res->cat = 0;
+      if (hash)
+	{
+	  e = id_hash_find_in(hash, size, cat, id12, id34);
+	  res->cat = ID_LOAD(e->cat);
+	  res->src = ID_LOAD(e->src);
+	  res->expires = ID_LOAD(e->expires);
+	  res->name = ID_LOAD(e->name);
+	}
+    }
+  while (id_read_retry(db, seq));
+}
+
+static void
+id_hash_resize(struct pci_access *a, unsigned int size)
+{
+  struct id_entry *old = a->id_db->hash;
+  struct id_entry *new;
+  unsigned int old_size = a->id_db->hash_size;
+  unsigned int i;
+
+  new = pci_malloc(a, sizeof(struct id_entry) * size);
+  memset(new, 0, sizeof(struct id_entry) * size);
+  for (i=0; i<old_size; i++)
+    if (old[i].cat)
+      *id_hash_find_in(new, size, old[i].cat, old[i].id12, old[i].id34) = old[i];
+  id_write_begin(a->id_db);
+  ID_STORE(a->id_db->hash, new);
+  ID_STORE(a->id_db->hash_size, size);
+  id_write_end(a->id_db);
+  id_hash_retire(a, old);
+}
+
+/*
+ *  Every ID is stored at most once. An entry from a source of lower
+ *  precedence (see enum id_entry_src) is replaced, as are cache entries
+ *  by later records for the same ID. Returns 1 if an existing entry
+ *  has been kept, which means a duplicate for the ID list.
+ */
+static int
+id_insert(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src, u32 expires, int copy)
 {
   u32 id12 = id_pair(id1, id2);
   u32 id34 = id_pair(id3, id4);
-  unsigned int h = id_hash(cat, id12, id34);
-  struct id_entry *n = a->id_hash ? a->id_hash[h] : NULL;
-  int len = strlen(text);
-
-  while (n && (n->id12 != id12 || n->id34 != id34 || n->cat != cat))
-    n = n->next;
-  if (n)
-    return 1;
-  n = id_alloc(a, sizeof(struct id_entry) + len);
-  n->id12 = id12;
-  n->id34 = id34;
-  n->cat = cat;
-  n->src = src;
-  memcpy(n->name, text, len+1);
-  n->next = a->id_hash[h];
-  a->id_hash[h] = n;
+  struct id_entry *n;
+  int dense = id_dense_p(cat, id12, id34);
+
+  if (!a->id_db->hash)
+    id_hash_resize(a, HASH_INITIAL_SIZE);
+  else if (!dense && 2 * (a->id_db->hash_count + 1) > a->id_db->hash_size)
+    id_hash_resize(a, 2 * a->id_db->hash_size);
+
+  if (dense)
+    {
+      id_write_begin(a->id_db);
+      n = id_dense_find(a, cat, id12, id34, 1);
+      id_write_end(a->id_db);
+    }
+  else
+    n = id_hash_find(a, cat, id12, id34);
+  if (n->cat)
+    {
+      if (n->src > src || (n->src == src && src != SRC_CACHE))
+	return 1;
+    }
+  else if (!dense)
+    a->id_db->hash_count++;
+  if (copy)
+    text = id_intern(a, text);
+  id_write_begin(a->id_db);
+  ID_STORE(n->id12, id12);
+  ID_STORE(n->id34, id34);
+  ID_STORE(n->cat, cat);
+  ID_STORE(n->src, src);
+  ID_STORE(n->expires, expires);
+  ID_STORE(n->name, text);
+  id_write_end(a->id_db);
   return 0;
 }
 
+int
+pci_id_insert_expiring(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src, u32 expires)
+{
+  return id_insert(a, cat, id1, id2, id3, id4, text, src, expires, 1);
+}
+
+/* The name is not copied, so it must stay valid until the hash is freed */
+int
+pci_id_insert_static(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src)
+{
+  return id_insert(a, cat, id1, id2, id3, id4, text, src, 0, 0);
+}
+
+int
+pci_id_insert(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src)
+{
+  return pci_id_insert_expiring(a, cat, id1, id2, id3, id4, text, src, 0);
+}
+
 char
 *pci_id_lookup(struct pci_access *a, int flags, int cat, int id1, int id2, int id3, int id4)
 {
-  struct id_entry *n, *best;
+  struct id_entry e, *n = &e;
   u32 id12 = id_pair(id1, id2);
   u32 id34 = id_pair(id3, id4);
+  char *name;
+
+  /* The ID list linked into the library is tried first */
+  if (!(flags & PCI_LOOKUP_SKIP_LOCAL) && (name = pci_id_embedded_lookup(cat, id1, id2, id3, id4)))
+    return name;
 
-  if (a->id_hash)
-    {
-      n = a->id_hash[id_hash(cat, id12, id34)];
-      best = NULL;
-      for (; n; n=n->next)
-        {
-	  if (n->id12 != id12 || n->id34 != id34 || n->cat != cat)
-	    continue;
-	  if (n->src == SRC_LOCAL && (flags & PCI_LOOKUP_SKIP_LOCAL))
-	    continue;
-	  if (n->src == SRC_NET && !(flags & PCI_LOOKUP_NETWORK))
-	    continue;
-	  if (n->src == SRC_CACHE && !(flags & PCI_LOOKUP_CACHE))
-	    continue;
-	  if (n->src == SRC_HWDB && (flags & (PCI_LOOKUP_SKIP_LOCAL | PCI_LOOKUP_NO_HWDB)))
-	    continue;
-	  if (!best || best->src < n->src)
-	    best = n;
+  /* Entries in the binary index are local, so they always win (classes are copied to the dense tables) */
+  if (a->id_db->index && !(flags & PCI_LOOKUP_SKIP_LOCAL) && !id_dense_p(cat, id12, id34) &&
+      (name = pci_id_index_lookup(a, cat, id12, id34)))
+    return name;
+
+  if (ID_LOAD(a->id_db->hash))
+    {
+      /*
+       *  Every ID is stored at most once, so there is no need to choose
+       *  between entries from different sources. We only have to check
+       *  that the source of the entry is acceptable.
+       */
+      id_hash_get(a, cat, id12, id34, n);
+      if (!n->cat)
+	return NULL;
+      if (n->src == SRC_LOCAL && (flags & PCI_LOOKUP_SKIP_LOCAL))
+	return NULL;
+      if (n->src == SRC_NET && !(flags & PCI_LOOKUP_NETWORK))
+	return NULL;
+      if (n->src == SRC_CACHE && !(flags & PCI_LOOKUP_CACHE))
+	return NULL;
+      if (n->src == SRC_HWDB && (flags & (PCI_LOOKUP_SKIP_LOCAL | PCI_LOOKUP_NO_HWDB)))
+	return NULL;
+      if (n->src == SRC_HWDB_MISS)
+	return NULL;
+      return n->name;
+    }
+  return NULL;
+}
+
+/*
+ *  Walking over all entries: start with *pos = 0 and call repeatedly
+ *  until NULL is returned. Positions past the hash address the dense
+ *  tables: 256 classes, then 256*256 subclasses and 256*256*256 prog-if's.
+ *  Missing tables are skipped as a whole.
+ */
+struct id_entry *
+pci_id_walk(struct pci_access *a, unsigned int *pos)
+{
+  struct id_db *db = a->id_db;
+  struct id_classes *c = db->classes;
+  struct id_class_table *t;
+  struct id_entry *e, *p;
+  unsigned int i = *pos, k;
+
+  for (; i < db->hash_size; i++)
+    if (db->hash[i].cat)
+      {
+	*pos = i + 1;
+	return &db->hash[i];
+      }
+  while (c)
+    {
+      k = i - db->hash_size;
+      if (k < 0x100)
+	e = &c->classes[k];
+      else if ((k -= 0x100) < 0x10000)
+	{
+	  if (!(t = c->tables[k >> 8]))
+	    {
+	      i += 0x100 - (k & 0xff);
+	      continue;
+	    }
+	  e = &t->subclasses[k & 0xff];
+	}
+      else if ((k -= 0x10000) < 0x1000000)
+	{
+	  if (!(t = c->tables[k >> 16]))
+	    {
+	      i += 0x10000 - (k & 0xffff);
+	      continue;
+	    }
+	  if (!(p = t->progifs[(k >> 8) & 0xff]))
+	    {
+	      i += 0x100 - (k & 0xff);
+	      continue;
+	    }
+	  e = &p[k & 0xff];
+	}
+      else
+	break;
+      i++;
+      if (e->cat)
+	{
+	  *pos = i;
+	  return e;
 	}
-      if (best)
-	return best->name;
     }
+  *pos = i;
   return NULL;
 }
 
+/* Which source does the hash entry for the given ID come from (ignoring the index) */
+enum id_entry_src
+pci_id_source(struct pci_access *a, int cat, int id1, int id2, int id3, int id4)
+{
+  struct id_entry e;
+
+  id_hash_get(a, cat, id_pair(id1, id2), id_pair(id3, id4), &e);
+  return e.cat ? e.src : SRC_UNKNOWN;
+}
+
+/* Where does the name returned by pci_id_lookup() for the given ID come from */
+enum id_entry_src
+pci_id_name_source(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *name)
+{
+  u32 id12 = id_pair(id1, id2), id34 = id_pair(id3, id4);
+  struct id_entry e;
+
+  if (name == pci_id_embedded_lookup(cat, id1, id2, id3, id4))
+    return SRC_LOCAL;
+  if (a->id_db->index && !id_dense_p(cat, id12, id34) && name == pci_id_index_lookup(a, cat, id12, id34))
+    return SRC_LOCAL;
+  id_hash_get(a, cat, id12, id34, &e);
+  return (e.cat && e.name == name) ? e.src : SRC_UNKNOWN;
+}
+
 void
 pci_id_hash_free(struct pci_access *a)
 {
-  pci_mfree(a->id_hash);
-  a->id_hash = NULL;
-  while (a->current_id_bucket)
+  pci_mfree(a->id_db->hash);
+  id_hash_free_old(a->id_db);
+  id_dense_free(a->id_db);
+  a->id_db->hash = NULL;
+  a->id_db->hash_size = a->id_db->hash_count = 0;
+  if (a->id_db->strings)
+    {
+      pci_id_strings_drop(a);
+      pci_mfree(a->id_db->strings);
+      a->id_db->strings = NULL;
+    }
+  while (a->id_db->current_bucket)
     {
-      struct id_bucket *buck = a->current_id_bucket;
-      a->current_id_bucket = buck->next;
+      struct id_bucket *buck = a->id_db->current_bucket;
+      a->id_db->current_bucket = buck->next;
       pci_mfree(buck);
     }
 }
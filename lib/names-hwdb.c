@@ -18,15 +18,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+static int
+hwdb_init(struct pci_access *a)
+{
+  const char *disabled = pci_get_param(a, "hwdb.disable");
+  if (disabled && atoi(disabled))
+    return 0;
+
+  if (!a->id_db->udev_hwdb)
+    {
+      a->debug("Initializing UDEV HWDB\n");
+      a->id_db->udev = udev_new();
+      a->id_db->udev_hwdb = udev_hwdb_new(a->id_db->udev);
+    }
+  return 1;
+}
+
+static const char *
+hwdb_get(struct udev_list_entry *list, const char *key)
+{
+  struct udev_list_entry *entry;
+
+  udev_list_entry_foreach(entry, list)
+    if (strcmp(udev_list_entry_get_name(entry), key) == 0)
+      return udev_list_entry_get_value(entry);
+  return NULL;
+}
+
 char *
 pci_id_hwdb_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4)
 {
   char modalias[64];
   const char *key = NULL;
-
-  const char *disabled = pci_get_param(a, "hwdb.disable");
-  if (disabled && atoi(disabled))
-    return NULL;
+  const char *val;
 
   switch (cat)
     {
@@ -60,36 +84,103 @@ pci_id_hwdb_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int
       break;
     }
 
-  if (key)
+  if (key && hwdb_init(a) &&
+      (val = hwdb_get(udev_hwdb_get_properties_list_entry(a->id_db->udev_hwdb, modalias, 0), key)))
+    return pci_strdup(a, val);
+
+  return NULL;
+}
+
+static void
+hwdb_insert(struct pci_access *a, struct udev_list_entry *list, const char *key, int cat, int id1, int id2, int id3, int id4)
+{
+  const char *val = hwdb_get(list, key);
+
+  if (val)
+    pci_id_insert(a, cat, id1, id2, id3, id4, (char *) val, SRC_HWDB);
+  else
+    pci_id_insert(a, cat, id1, id2, id3, id4, "", SRC_HWDB_MISS);
+}
+
+/*
+ *  A single HWDB query returns properties of all patterns matching the
+ *  modalias, so we can learn several names at once. The queries are the
+ *  same as in pci_id_hwdb_lookup(), only the results of more of them are
+ *  recorded, including negative ones:
+ *
+ *	ID_VENDOR	(vendor) -> vendor
+ *	ID_DEVICE	(vendor, device) -> vendor, device
+ *	ID_SUBSYSTEM	(vendor, device, subvendor, subdevice) -> vendor, subsystem
+ *	ID_SUBCLASS	(class, subclass) -> class, subclass
+ *	ID_PROGIF	(class, subclass, prog_if) -> class, subclass, prog-if
+ */
+int
+pci_id_hwdb_preload(struct pci_access *a, int cat, int id1, int id2, int id3, int id4)
+{
+  char modalias[64];
+  struct udev_list_entry *list;
+
+  switch (cat)
     {
-      if (!a->id_udev_hwdb)
-	{
-	  a->debug("Initializing UDEV HWDB\n");
-	  a->id_udev = udev_new();
-	  a->id_udev_hwdb = udev_hwdb_new(a->id_udev);
-	}
-
-      struct udev_list_entry *entry;
-      udev_list_entry_foreach(entry, udev_hwdb_get_properties_list_entry(a->id_udev_hwdb, modalias, 0))
-        if (strcmp(udev_list_entry_get_name(entry), key) == 0)
-    	  return pci_strdup(a, udev_list_entry_get_value(entry));
+    case ID_VENDOR:
+      sprintf(modalias, "pci:v%08X*", id1);
+      break;
+    case ID_DEVICE:
+      sprintf(modalias, "pci:v%08Xd%08X*", id1, id2);
+      break;
+    case ID_SUBSYSTEM:
+      sprintf(modalias, "pci:v%08Xd%08Xsv%08Xsd%08X*", id1, id2, id3, id4);
+      break;
+    case ID_SUBCLASS:
+      sprintf(modalias, "pci:v*d*sv*sd*bc%02Xsc%02X*", id1, id2);
+      break;
+    case ID_PROGIF:
+      sprintf(modalias, "pci:v*d*sv*sd*bc%02Xsc%02Xi%02X*", id1, id2, id3);
+      break;
+    default:
+      return 0;
     }
 
-  return NULL;
+  if (!hwdb_init(a))
+    return 0;
+  list = udev_hwdb_get_properties_list_entry(a->id_db->udev_hwdb, modalias, 0);
+
+  switch (cat)
+    {
+    case ID_VENDOR:
+      hwdb_insert(a, list, "ID_VENDOR_FROM_DATABASE", ID_VENDOR, id1, 0, 0, 0);
+      break;
+    case ID_DEVICE:
+      hwdb_insert(a, list, "ID_VENDOR_FROM_DATABASE", ID_VENDOR, id1, 0, 0, 0);
+      hwdb_insert(a, list, "ID_MODEL_FROM_DATABASE", ID_DEVICE, id1, id2, 0, 0);
+      break;
+    case ID_SUBSYSTEM:
+      hwdb_insert(a, list, "ID_VENDOR_FROM_DATABASE", ID_VENDOR, id1, 0, 0, 0);
+      hwdb_insert(a, list, "ID_MODEL_FROM_DATABASE", ID_SUBSYSTEM, id1, id2, id3, id4);
+      break;
+    case ID_PROGIF:
+      hwdb_insert(a, list, "ID_PCI_INTERFACE_FROM_DATABASE", ID_PROGIF, id1, id2, id3, 0);
+      /* Fall through */
+    case ID_SUBCLASS:
+      hwdb_insert(a, list, "ID_PCI_CLASS_FROM_DATABASE", ID_CLASS, id1, 0, 0, 0);
+      hwdb_insert(a, list, "ID_PCI_SUBCLASS_FROM_DATABASE", ID_SUBCLASS, id1, id2, 0, 0);
+      break;
+    }
+  return 1;
 }
 
 void
 pci_id_hwdb_free(struct pci_access *a)
 {
-  if (a->id_udev_hwdb)
+  if (a->id_db->udev_hwdb)
     {
-      udev_hwdb_unref(a->id_udev_hwdb);
-      a->id_udev_hwdb = NULL;
+      udev_hwdb_unref(a->id_db->udev_hwdb);
+      a->id_db->udev_hwdb = NULL;
     }
-  if (a->id_udev)
+  if (a->id_db->udev)
     {
-      udev_unref(a->id_udev);
-      a->id_udev = NULL;
+      udev_unref(a->id_db->udev);
+      a->id_db->udev = NULL;
     }
 }
 
@@ -101,6 +192,12 @@ pci_id_hwdb_lookup(struct pci_access *a UNUSED, int cat UNUSED, int id1 UNUSED,
   return NULL;
 }
 
+int
+pci_id_hwdb_preload(struct pci_access *a UNUSED, int cat UNUSED, int id1 UNUSED, int id2 UNUSED, int id3 UNUSED, int id4 UNUSED)
+{
+  return 0;
+}
+
 void
 pci_id_hwdb_free(struct pci_access *a UNUSED)
 {
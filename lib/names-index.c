@@ -0,0 +1,564 @@
+/*
+ *	The PCI Library -- Binary Index of the ID List
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "names.h"
+
+#if defined(PCI_HAVE_MMAP) || defined(PCI_HAVE_SHM)
+#include <sys/mman.h>
+#endif
+
+#ifdef PCI_HAVE_SHM
+#include <time.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ *  The index is a single file consisting of a header, an array of entries
+ *  sorted by (cat, id12, id34) and a pool of NUL-terminated names. All numbers
+ *  are stored in the native byte order; an index created on a machine with
+ *  a different byte order is simply ignored.
+ */
+
+struct id_index {
+  byte *data;
+  size_t size;
+  int mapped;
+  struct id_index_entry *entries;
+  u32 num_entries;
+  char *strings;
+  u32 strings_size;
+};
+
+char *
+pci_id_index_name(struct pci_access *a, char *buf, int size)
+{
+  int n = snprintf(buf, size, "%s.idx", a->id_file_name);
+  if (n < 0 || n >= size)
+    return NULL;
+  return buf;
+}
+
+static int
+id_index_stat(char *name, u64 *size, u64 *mtime)
+{
+  struct stat st;
+
+  if (stat(name, &st) < 0)
+    return 0;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return 1;
+}
+
+static byte *
+id_index_map(struct pci_access *a, int fd, size_t size, int *mapped)
+{
+  byte *data;
+  size_t pos;
+  int n;
+
+#ifdef PCI_HAVE_MMAP
+  data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data != MAP_FAILED)
+    {
+      *mapped = 1;
+      return data;
+    }
+#endif
+
+  *mapped = 0;
+  data = pci_malloc(a, size);
+  for (pos = 0; pos < size; pos += n)
+    {
+      n = read(fd, data + pos, size - pos);
+      if (n <= 0)
+	{
+	  pci_mfree(data);
+	  return NULL;
+	}
+    }
+  return data;
+}
+
+static void
+id_index_unmap(struct id_index *x)
+{
+#ifdef PCI_HAVE_MMAP
+  if (x->mapped)
+    {
+      munmap(x->data, x->size);
+      return;
+    }
+#endif
+  pci_mfree(x->data);
+}
+
+/* Checks that the header describes a consistent index and sets up the pointers */
+static int
+id_index_check(struct id_index *x)
+{
+  struct id_index_header *h = (struct id_index_header *) x->data;
+
+  if (x->size < sizeof(*h) ||
+      h->magic != ID_INDEX_MAGIC ||
+      h->version != ID_INDEX_VERSION ||
+      h->entries_offset % sizeof(u32) ||
+      h->entries_offset < sizeof(*h) ||
+      h->entries_offset > x->size ||
+      h->num_entries > (x->size - h->entries_offset) / sizeof(struct id_index_entry) ||
+      h->strings_offset > x->size ||
+      h->strings_size > x->size - h->strings_offset ||
+      !h->strings_size ||
+      x->data[h->strings_offset + h->strings_size - 1])
+    return 0;
+
+  x->entries = (struct id_index_entry *) (x->data + h->entries_offset);
+  x->num_entries = h->num_entries;
+  x->strings = (char *) x->data + h->strings_offset;
+  x->strings_size = h->strings_size;
+  return 1;
+}
+
+enum id_index_status {
+  ID_INDEX_OK,
+  ID_INDEX_MALFORMED,
+  ID_INDEX_STALE,
+};
+
+/* Maps an index from an open file and checks that it belongs to the current ID list */
+static enum id_index_status
+id_index_open(struct pci_access *a, int fd, size_t size, struct id_index **xp)
+{
+  struct id_index *x;
+  struct id_index_header *h;
+  u64 src_size, src_mtime;
+
+  x = pci_malloc(a, sizeof(*x));
+  memset(x, 0, sizeof(*x));
+  x->size = size;
+  x->data = id_index_map(a, fd, x->size, &x->mapped);
+  if (!x->data)
+    {
+      pci_mfree(x);
+      return ID_INDEX_MALFORMED;
+    }
+
+  if (!id_index_check(x))
+    {
+      id_index_unmap(x);
+      pci_mfree(x);
+      return ID_INDEX_MALFORMED;
+    }
+
+  /* If the source file is present, the index must have been built from it */
+  h = (struct id_index_header *) x->data;
+  if (id_index_stat(a->id_file_name, &src_size, &src_mtime) &&
+      (src_size != h->src_size || src_mtime != h->src_mtime))
+    {
+      id_index_unmap(x);
+      pci_mfree(x);
+      return ID_INDEX_STALE;
+    }
+
+  *xp = x;
+  return ID_INDEX_OK;
+}
+
+/*
+ *  Class entries are copied to the dense tables in the hash (they are
+ *  at the end of the sorted array), so that looking them up does not
+ *  need a binary search.
+ */
+static void
+id_index_classes(struct pci_access *a, struct id_index *x)
+{
+  u32 i = x->num_entries;
+  struct id_index_entry *e;
+
+  while (i > 0 && (e = &x->entries[i-1])->cat >= ID_CLASS)
+    {
+      if (e->cat <= ID_PROGIF && e->name < x->strings_size)
+	pci_id_insert_static(a, e->cat, pair_first(e->id12), pair_second(e->id12), pair_first(e->id34), pair_second(e->id34),
+			     x->strings + e->name, SRC_LOCAL);
+      i--;
+    }
+}
+
+int
+pci_id_index_load(struct pci_access *a)
+{
+  char name[MAX_LINE];
+  struct id_index *x;
+  struct stat st;
+  int fd;
+
+  if (!pci_id_index_name(a, name, sizeof(name)))
+    return 0;
+  fd = open(name, O_RDONLY | O_BINARY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) < 0)
+    {
+      close(fd);
+      return 0;
+    }
+
+  switch (id_index_open(a, fd, st.st_size, &x))
+    {
+    case ID_INDEX_OK:
+      a->debug("Using ID index %s (%d entries)\n", name, x->num_entries);
+      a->id_db->index = x;
+      id_index_classes(a, x);
+      break;
+    case ID_INDEX_MALFORMED:
+      a->debug("Ignoring malformed ID index %s\n", name);
+      break;
+    case ID_INDEX_STALE:
+      a->debug("ID index %s is stale, ignoring\n", name);
+      break;
+    }
+  close(fd);
+  return !!a->id_db->index;
+}
+
+static inline int
+id_index_cmp(u32 cat1, u32 id12_1, u32 id34_1, struct id_index_entry *e)
+{
+  if (cat1 != e->cat)
+    return (cat1 < e->cat) ? -1 : 1;
+  if (id12_1 != e->id12)
+    return (id12_1 < e->id12) ? -1 : 1;
+  if (id34_1 != e->id34)
+    return (id34_1 < e->id34) ? -1 : 1;
+  return 0;
+}
+
+char *
+pci_id_index_lookup(struct pci_access *a, int cat, u32 id12, u32 id34)
+{
+  struct id_index *x = a->id_db->index;
+  u32 l = 0, r = x->num_entries;
+
+  while (l < r)
+    {
+      u32 m = (l + r) / 2;
+      struct id_index_entry *e = &x->entries[m];
+      int c = id_index_cmp(cat, id12, id34, e);
+      if (!c)
+	return (e->name < x->strings_size) ? x->strings + e->name : NULL;
+      if (c < 0)
+	r = m;
+      else
+	l = m + 1;
+    }
+  return NULL;
+}
+
+void
+pci_id_index_free(struct pci_access *a)
+{
+  if (a->id_db->index)
+    {
+      id_index_unmap(a->id_db->index);
+      pci_mfree(a->id_db->index);
+      a->id_db->index = NULL;
+    }
+}
+
+struct id_index_entry *
+pci_id_index_entries(struct pci_access *a, u32 *num, char **strings, u32 *strings_size)
+{
+  struct id_index *x = a->id_db->index;
+
+  *num = x->num_entries;
+  *strings = x->strings;
+  *strings_size = x->strings_size;
+  return x->entries;
+}
+
+static int
+id_index_sort_cmp(const void *A, const void *B)
+{
+  const struct id_index_entry *a = A, *b = B;
+  return id_index_cmp(a->cat, a->id12, a->id34, (struct id_index_entry *) b);
+}
+
+static int
+id_index_write_all(int fd, void *buf, size_t len)
+{
+  byte *p = buf;
+  int n;
+
+  while (len)
+    {
+      n = write(fd, p, len);
+      if (n <= 0)
+	return 0;
+      p += n;
+      len -= n;
+    }
+  return 1;
+}
+
+/* Builds an index of all local entries in the hash */
+static int
+id_index_build(struct pci_access *a, struct id_index_header *hp, struct id_index_entry **entriesp, char **stringsp)
+{
+  struct id_index_header h;
+  struct id_index_entry *entries;
+  struct id_entry *e;
+  unsigned int i, cnt, strsize, pos;
+  char *strings;
+
+  memset(&h, 0, sizeof(h));
+  if (!id_index_stat(a->id_file_name, &h.src_size, &h.src_mtime))
+    {
+      a->warning("Cannot stat %s: %s", a->id_file_name, strerror(errno));
+      return 0;
+    }
+
+  cnt = 0;
+  strsize = 1;
+  i = 0;
+  while (e = pci_id_walk(a, &i))
+    {
+      if (e->src == SRC_LOCAL)
+	{
+	  cnt++;
+	  strsize += strlen(e->name) + 1;
+	}
+    }
+
+  entries = pci_malloc(a, cnt * sizeof(*entries) + 1);
+  strings = pci_malloc(a, strsize);
+  strings[0] = 0;
+  cnt = 0;
+  pos = 1;
+  i = 0;
+  while (e = pci_id_walk(a, &i))
+    {
+      if (e->src == SRC_LOCAL)
+	{
+	  int len = strlen(e->name) + 1;
+	  entries[cnt].id12 = e->id12;
+	  entries[cnt].id34 = e->id34;
+	  entries[cnt].cat = e->cat;
+	  entries[cnt].name = pos;
+	  memcpy(strings + pos, e->name, len);
+	  pos += len;
+	  cnt++;
+	}
+    }
+  qsort(entries, cnt, sizeof(*entries), id_index_sort_cmp);
+
+  h.magic = ID_INDEX_MAGIC;
+  h.version = ID_INDEX_VERSION;
+  h.num_entries = cnt;
+  h.entries_offset = sizeof(h);
+  h.strings_offset = h.entries_offset + cnt * sizeof(*entries);
+  h.strings_size = strsize;
+
+  *hp = h;
+  *entriesp = entries;
+  *stringsp = strings;
+  return 1;
+}
+
+int
+pci_id_index_write(struct pci_access *a, char *name)
+{
+  struct id_index_header h;
+  struct id_index_entry *entries;
+  char *strings, *tmpname;
+  int fd, ok;
+
+  if (!id_index_build(a, &h, &entries, &strings))
+    return 0;
+
+  tmpname = pci_malloc(a, strlen(name) + 32);
+  sprintf(tmpname, "%s.tmp-%d", name, (int) getpid());
+  fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+  if (fd < 0)
+    {
+      a->warning("Cannot create %s: %s", tmpname, strerror(errno));
+      ok = 0;
+    }
+  else
+    {
+      ok = id_index_write_all(fd, &h, sizeof(h)) &&
+	   id_index_write_all(fd, entries, h.num_entries * sizeof(*entries)) &&
+	   id_index_write_all(fd, strings, h.strings_size);
+      if (close(fd) < 0)
+	ok = 0;
+      if (!ok)
+	a->warning("Error writing %s: %s", tmpname, strerror(errno));
+      else if (rename(tmpname, name) < 0)
+	{
+	  a->warning("Cannot rename %s to %s: %s", tmpname, name, strerror(errno));
+	  ok = 0;
+	}
+      if (!ok)
+	unlink(tmpname);
+      else
+	a->debug("Written ID index %s (%d entries)\n", name, h.num_entries);
+    }
+
+  pci_mfree(tmpname);
+  pci_mfree(strings);
+  pci_mfree(entries);
+  return ok;
+}
+
+#ifdef PCI_HAVE_SHM
+
+/*
+ *  With names.shm set, the first process which parses the ID list publishes
+ *  its index in a POSIX shared memory segment and other processes of the same
+ *  user attach to it instead of parsing. The segment is named after the user
+ *  and the path of the ID list; its header records the size and mtime of the
+ *  list just like in the index file. The magic number is written last, so
+ *  a segment which is still being built (or whose builder has died) is never
+ *  used. Stale, corrupted and abandoned segments are unlinked, so that they
+ *  get replaced; processes which have them mapped are not affected.
+ */
+
+#define ID_SHM_ABANDONED 10		/* Seconds after which an unfinished segment is considered dead */
+
+static void
+id_shm_name(struct pci_access *a, char *buf)
+{
+  u32 h = 2166136261U;
+  char *p;
+
+  for (p = a->id_file_name; *p; p++)
+    h = (h ^ (byte) *p) * 16777619;
+  sprintf(buf, "/libpci-ids-%u-%08x", (unsigned int) geteuid(), h);
+}
+
+int
+pci_id_shm_attach(struct pci_access *a)
+{
+  char name[64];
+  struct id_index *x;
+  struct stat st;
+  u32 magic;
+  int fd;
+
+  id_shm_name(a, name);
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) < 0 || st.st_uid != geteuid())
+    {
+      close(fd);
+      return 0;
+    }
+
+  if (st.st_size < (off_t) sizeof(struct id_index_header) ||
+      pread(fd, &magic, sizeof(magic), 0) != sizeof(magic) || !magic)
+    {
+      close(fd);
+      if (st.st_mtime + ID_SHM_ABANDONED < time(NULL))
+	{
+	  a->debug("Removing abandoned shared ID table %s\n", name);
+	  shm_unlink(name);
+	}
+      else
+	a->debug("Shared ID table %s is not ready yet\n", name);
+      return 0;
+    }
+
+  switch (id_index_open(a, fd, st.st_size, &x))
+    {
+    case ID_INDEX_OK:
+      a->debug("Using shared ID table %s (%d entries)\n", name, x->num_entries);
+      a->id_db->index = x;
+      id_index_classes(a, x);
+      break;
+    case ID_INDEX_MALFORMED:
+      a->debug("Removing corrupted shared ID table %s\n", name);
+      shm_unlink(name);
+      break;
+    case ID_INDEX_STALE:
+      a->debug("Removing stale shared ID table %s\n", name);
+      shm_unlink(name);
+      break;
+    }
+  close(fd);
+  return !!a->id_db->index;
+}
+
+void
+pci_id_shm_publish(struct pci_access *a)
+{
+  char name[64];
+  struct id_index_header h;
+  struct id_index_entry *entries;
+  char *strings;
+  u32 magic;
+  int fd, ok;
+
+  if (!id_index_build(a, &h, &entries, &strings))
+    return;
+
+  id_shm_name(a, name);
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    {
+      /* Somebody else is publishing it right now */
+      a->debug("Cannot create shared ID table %s: %s\n", name, strerror(errno));
+      goto out;
+    }
+
+  magic = h.magic;
+  h.magic = 0;
+  ok = id_index_write_all(fd, &h, sizeof(h)) &&
+       id_index_write_all(fd, entries, h.num_entries * sizeof(*entries)) &&
+       id_index_write_all(fd, strings, h.strings_size) &&
+       pwrite(fd, &magic, sizeof(magic), 0) == sizeof(magic);
+  close(fd);
+  if (ok)
+    a->debug("Published shared ID table %s (%d entries)\n", name, h.num_entries);
+  else
+    {
+      a->debug("Error writing shared ID table %s: %s\n", name, strerror(errno));
+      shm_unlink(name);
+    }
+
+out:
+  pci_mfree(strings);
+  pci_mfree(entries);
+}
+
+#else
+
+int
+pci_id_shm_attach(struct pci_access *a UNUSED)
+{
+  return 0;
+}
+
+void
+pci_id_shm_publish(struct pci_access *a UNUSED)
+{
+}
+
+#endif
@@ -27,6 +27,11 @@
 #include <arpa/nameser.h>
 #include <resolv.h>
 #include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
 
 /*
  * Unfortunately, there are no portable functions for DNS RR parsing,
@@ -156,19 +161,21 @@ err:
   return -1;
 }
 
-char
-*pci_id_net_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4)
+/* How long do we remember that an ID is not known to the DNS */
+static unsigned int
+dns_negative_ttl(struct pci_access *a)
 {
-  static int resolver_inited;
-  char name[256], dnsname[256], txt[256], *domain;
-  byte answer[4096];
-  const byte *data;
-  int res, j, dlen;
-  struct dns_state ds;
+  return atoi(pci_get_param(a, "net.negative_ttl"));
+}
+
+static int
+dns_query_name(struct pci_access *a, char *dnsname, int cat, int id1, int id2, int id3, int id4)
+{
+  char name[256], *domain;
 
   domain = pci_get_param(a, "net.domain");
   if (!domain || !domain[0])
-    return NULL;
+    return 0;
 
   switch (cat)
     {
@@ -194,23 +201,22 @@ char
       sprintf(name, "%02x.%02x.%02x.c", id3, id2, id1);
       break;
     default:
-      return NULL;
+      return 0;
     }
-  sprintf(dnsname, "%s.%s", name, domain);
+  snprintf(dnsname, 256, "%s.%s", name, domain);
+  return 1;
+}
 
-  a->debug("Resolving %s\n", dnsname);
-  if (!resolver_inited)
-    {
-      resolver_inited = 1;
-      res_init();
-    }
-  res = res_query(dnsname, ns_c_in, ns_t_txt, answer, sizeof(answer));
-  if (res < 0)
-    {
-      a->debug("\tfailed, h_errno=%d\n", h_errno);
-      return NULL;
-    }
-  if (dns_parse_packet(&ds, answer, res) < 0)
+/* Find the "i=<name>" TXT record in the answer */
+static char *
+dns_find_name(struct pci_access *a, byte *answer, int len, unsigned int *ttl)
+{
+  char txt[256];
+  const byte *data;
+  int j, dlen;
+  struct dns_state ds;
+
+  if (dns_parse_packet(&ds, answer, len) < 0)
     {
       a->debug("\tMalformed DNS packet received\n");
       return NULL;
@@ -233,18 +239,284 @@ char
 	  j += 1+data[j];
 	  a->debug("\t\"%s\"\n", txt);
 	  if (txt[0] == 'i' && txt[1] == '=')
-	    return strdup(txt+2);
+	    {
+	      *ttl = ds.rr_ttl;
+	      return strdup(txt+2);
+	    }
 	}
     }
 
+  *ttl = dns_negative_ttl(a);
   return NULL;
 }
 
+static void
+dns_init(void)
+{
+  static int resolver_inited;
+
+  if (!resolver_inited)
+    {
+      resolver_inited = 1;
+      res_init();
+    }
+}
+
+char
+*pci_id_net_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, unsigned int *ttl)
+{
+  char dnsname[256];
+  byte answer[4096];
+  int res;
+
+  *ttl = 0;
+  if (!dns_query_name(a, dnsname, cat, id1, id2, id3, id4))
+    return NULL;
+
+  a->debug("Resolving %s\n", dnsname);
+  dns_init();
+  res = res_query(dnsname, ns_c_in, ns_t_txt, answer, sizeof(answer));
+  if (res < 0)
+    {
+      a->debug("\tfailed, h_errno=%d\n", h_errno);
+      if (h_errno == HOST_NOT_FOUND || h_errno == NO_DATA)
+	*ttl = dns_negative_ttl(a);
+      return NULL;
+    }
+  return dns_find_name(a, answer, res, ttl);
+}
+
+/*
+ *  Resolving many ID's at once: we send the queries over a single UDP socket
+ *  directly to the name server, keeping at most net.parallel of them in flight
+ *  and matching the replies by their ID and question. Truncated replies
+ *  are re-tried by res_query(), which knows how to use TCP.
+ */
+
+#define DNS_MAX_TRIES 2
+
+struct dns_slot {
+  int query;				/* Index in the array of queries, -1 if free */
+  int tries;
+  long deadline;			/* In milliseconds */
+  int len;
+  byte packet[PACKETSZ];
+};
+
+static long
+dns_now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000L + tv.tv_usec / 1000;
+}
+
+static int
+dns_open_socket(struct pci_access *a)
+{
+  char *server = pci_get_param(a, "net.server");
+  char *port = pci_get_param(a, "net.port");
+  struct addrinfo hints, *ai;
+  int fd, err, i;
+
+  if (server && server[0])
+    {
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_DGRAM;
+      hints.ai_flags = AI_NUMERICHOST;
+      if (err = getaddrinfo(server, (port && port[0]) ? port : "53", &hints, &ai))
+	{
+	  a->warning("Invalid DNS server %s: %s", server, gai_strerror(err));
+	  return -1;
+	}
+      fd = socket(ai->ai_family, SOCK_DGRAM, 0);
+      if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0)
+	{
+	  close(fd);
+	  fd = -1;
+	}
+      freeaddrinfo(ai);
+      return fd;
+    }
+
+  /*
+   *  The first IPv4 name server from resolv.conf (IPv6 ones are not in nsaddr_list).
+   *  If there is none, the caller falls back to res_query(), which knows them all.
+   */
+  for (i=0; i<_res.nscount && i<MAXNS; i++)
+    if (_res.nsaddr_list[i].sin_family == AF_INET)
+      {
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr *) &_res.nsaddr_list[i], sizeof(_res.nsaddr_list[i])) < 0)
+	  {
+	    close(fd);
+	    continue;
+	  }
+	return fd;
+      }
+  a->debug("No usable IPv4 name server\n");
+  return -1;
+}
+
+static int
+dns_send(int fd, struct dns_slot *s, int timeout)
+{
+  s->tries++;
+  s->deadline = dns_now() + timeout;
+  return send(fd, s->packet, s->len, 0) == s->len;
+}
+
+static void
+dns_receive(struct pci_access *a, int fd, struct dns_slot *slots, int nslots, struct id_net_query *q, unsigned int base)
+{
+  byte answer[4096];
+  int len, i, qi;
+  HEADER *h = (HEADER *) answer;
+
+  while ((len = recv(fd, answer, sizeof(answer), MSG_DONTWAIT)) >= 0)
+    {
+      if (len < HFIXEDSZ)
+	continue;
+      qi = (u16)(ntohs(h->id) - base);
+      for (i=0; i<nslots; i++)
+	if (slots[i].query == qi)
+	  break;
+      if (i >= nslots ||
+	  len < slots[i].len ||
+	  memcmp(answer + HFIXEDSZ, slots[i].packet + HFIXEDSZ, slots[i].len - HFIXEDSZ))
+	{
+	  a->debug("Ignoring unexpected DNS reply\n");
+	  continue;
+	}
+      slots[i].query = -1;
+      if (h->tc)
+	q[qi].name = pci_id_net_lookup(a, q[qi].cat, q[qi].id1, q[qi].id2, q[qi].id3, q[qi].id4, &q[qi].ttl);
+      else if (h->rcode == NXDOMAIN)
+	{
+	  a->debug("Query #%d: no such ID\n", qi);
+	  q[qi].ttl = dns_negative_ttl(a);
+	}
+      else if (h->rcode != NOERROR)
+	a->debug("Query #%d failed, rcode=%d\n", qi, h->rcode);
+      else
+	{
+	  a->debug("Reply to query #%d\n", qi);
+	  q[qi].name = dns_find_name(a, answer, len, &q[qi].ttl);
+	}
+    }
+}
+
+void
+pci_id_net_lookup_many(struct pci_access *a, struct id_net_query *q, int n)
+{
+  struct dns_slot *slots;
+  int nslots, timeout, fd, next, active, i;
+  unsigned int base;
+  char dnsname[256];
+  struct pollfd pfd;
+  long now, wait;
+
+  for (i=0; i<n; i++)
+    {
+      q[i].name = NULL;
+      q[i].ttl = 0;
+    }
+
+  dns_init();
+  nslots = atoi(pci_get_param(a, "net.parallel"));
+  timeout = atoi(pci_get_param(a, "net.timeout"));
+  if (nslots > n)
+    nslots = n;
+  if (nslots < 1 || timeout <= 0 || n >= 0x10000 || (fd = dns_open_socket(a)) < 0)
+    {
+      a->debug("Resolving %d ID's sequentially\n", n);
+      for (i=0; i<n; i++)
+	q[i].name = pci_id_net_lookup(a, q[i].cat, q[i].id1, q[i].id2, q[i].id3, q[i].id4, &q[i].ttl);
+      return;
+    }
+
+  a->debug("Resolving %d ID's, %d in parallel\n", n, nslots);
+  slots = pci_malloc(a, nslots * sizeof(struct dns_slot));
+  for (i=0; i<nslots; i++)
+    slots[i].query = -1;
+  base = (getpid() ^ dns_now()) & 0xffff;
+  next = 0;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  for (;;)
+    {
+      /* Fill free slots with new queries and re-send the timed out ones */
+      active = 0;
+      now = dns_now();
+      wait = timeout;
+      for (i=0; i<nslots; i++)
+	{
+	  struct dns_slot *s = &slots[i];
+	  if (s->query >= 0 && s->deadline <= now)
+	    {
+	      if (s->tries < DNS_MAX_TRIES)
+		{
+		  a->debug("Query #%d timed out, re-sending\n", s->query);
+		  dns_send(fd, s, timeout);
+		}
+	      else
+		{
+		  a->debug("Query #%d timed out\n", s->query);
+		  s->query = -1;
+		}
+	    }
+	  while (s->query < 0 && next < n)
+	    {
+	      struct id_net_query *x = &q[next++];
+	      if (!dns_query_name(a, dnsname, x->cat, x->id1, x->id2, x->id3, x->id4))
+		continue;
+	      a->debug("Resolving %s as query #%d\n", dnsname, (int)(x - q));
+	      s->len = res_mkquery(QUERY, dnsname, ns_c_in, ns_t_txt, NULL, 0, NULL, s->packet, sizeof(s->packet));
+	      if (s->len < HFIXEDSZ)
+		continue;
+	      ((HEADER *) s->packet)->id = htons((base + (x - q)) & 0xffff);
+	      s->query = x - q;
+	      s->tries = 0;
+	      if (!dns_send(fd, s, timeout))
+		a->debug("\tsend failed: %s\n", strerror(errno));
+	    }
+	  if (s->query >= 0)
+	    {
+	      active++;
+	      if (s->deadline - now < wait)
+		wait = s->deadline - now;
+	    }
+	}
+      if (!active)
+	break;
+
+      if (poll(&pfd, 1, (wait > 0) ? wait : 0) > 0)
+	dns_receive(a, fd, slots, nslots, q, base);
+    }
+
+  pci_mfree(slots);
+  close(fd);
+}
+
 #else
 
-char *pci_id_net_lookup(struct pci_access *a UNUSED, int cat UNUSED, int id1 UNUSED, int id2 UNUSED, int id3 UNUSED, int id4 UNUSED)
+char *pci_id_net_lookup(struct pci_access *a UNUSED, int cat UNUSED, int id1 UNUSED, int id2 UNUSED, int id3 UNUSED, int id4 UNUSED, unsigned int *ttl)
 {
+  *ttl = 0;
   return NULL;
 }
 
+void pci_id_net_lookup_many(struct pci_access *a UNUSED, struct id_net_query *q, int n)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    {
+      q[i].name = NULL;
+      q[i].ttl = 0;
+    }
+}
+
 #endif
@@ -14,48 +14,414 @@
 #include "internal.h"
 #include "names.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef PCI_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #ifdef PCI_COMPRESSED_IDS
 #include <zlib.h>
-typedef gzFile pci_file;
-#define pci_gets(f, l, s)	gzgets(f, l, s)
-#define pci_eof(f)		gzeof(f)
-
-static pci_file pci_open(struct pci_access *a)
-{
-  pci_file result;
-  size_t len;
-  char *new_name;
-
-  result = gzopen(a->id_file_name, "rb");
-  if (result)
-    return result;
-  len = strlen(a->id_file_name);
-  if (len < 3 || memcmp(a->id_file_name + len - 3, ".gz", 3) != 0)
-    return result;
-  new_name = malloc(len - 2);
-  memcpy(new_name, a->id_file_name, len - 3);
-  new_name[len - 3] = 0;
-  pci_set_name_list_path(a, new_name, 1);
-  return gzopen(a->id_file_name, "rb");
-}
-
-#define pci_close(f)		gzclose(f)
-#define PCI_ERROR(f, err)						\
-	if (!err) {							\
-		int errnum;						\
-		gzerror(f, &errnum);					\
-		if (errnum >= 0) err = NULL;				\
-		else if (errnum == Z_ERRNO) err = "I/O error";		\
-		else err = zError(errnum);				\
+#endif
+
+#ifdef PCI_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ *  The ID list is read in large blocks, which are decompressed if needed
+ *  and split to lines in memory. Compressed files are recognized by their
+ *  magic bytes, so any name can be used for any format.
+ *
+ *  When the whole list is parsed at once, an uncompressed file is mapped
+ *  to memory instead (see id_file_whole()) and lines are terminated in place,
+ *  so they need not be copied. The names are interned as usual and the mapping
+ *  is dropped when parsing is finished.
+ */
+
+#define ID_FILE_BUFSIZE 65536
+
+enum id_file_format {
+  ID_FILE_PLAIN,
+  ID_FILE_GZIP,
+  ID_FILE_ZSTD,
+};
+
+struct id_file {
+  int fd;
+  enum id_file_format format;
+  char *buf;				/* Decompressed data */
+  unsigned int buf_pos, buf_end;	/* Not yet processed part of buf */
+  long buf_offset;			/* Position of buf[buf_pos] in the decompressed data */
+  byte *in;				/* Compressed data */
+  unsigned int in_pos, in_end;
+  int in_eof, eof;
+  const char *err;
+  long line_pos;			/* Position of the last line returned */
+  unsigned int line_len;		/* ... and its length without the newline */
+  size_t mapped;			/* Size of the mapping if buf is mmapped */
+#ifdef PCI_COMPRESSED_IDS
+  z_stream z;
+#endif
+#ifdef PCI_HAVE_ZSTD
+  ZSTD_DCtx *zstd;
+#endif
+};
+
+static int
+id_file_read(struct id_file *f, void *buf, unsigned int size)
+{
+  int n = read(f->fd, buf, size);
+  if (n < 0)
+    f->err = "I/O error";
+  return n;
+}
+
+/* Refill the input buffer of a compressed file; returns 0 at EOF, -1 on error */
+static int
+id_file_read_in(struct id_file *f)
+{
+  int n;
+
+  if (f->in_pos < f->in_end)
+    return 1;
+  if (f->in_eof)
+    return 0;
+  n = id_file_read(f, f->in, ID_FILE_BUFSIZE);
+  if (n < 0)
+    return -1;
+  if (!n)
+    f->in_eof = 1;
+  f->in_pos = 0;
+  f->in_end = n;
+  return (n > 0);
+}
+
+#ifdef PCI_COMPRESSED_IDS
+
+static int
+id_file_inflate(struct id_file *f, char *out, unsigned int size)
+{
+  int err, n;
+
+  for (;;)
+    {
+      if ((n = id_file_read_in(f)) <= 0)
+	{
+	  if (!n && f->z.total_in)
+	    f->err = "Unexpected end of compressed data";
+	  return n;
 	}
-#else
-typedef FILE * pci_file;
-#define pci_gets(f, l, s)	fgets(l, s, f)
-#define pci_eof(f)		feof(f)
-#define pci_open(a)		fopen(a->id_file_name, "r")
-#define pci_close(f)		fclose(f)
-#define PCI_ERROR(f, err)	if (!err && ferror(f))	err = "I/O error";
+      f->z.next_in = f->in + f->in_pos;
+      f->z.avail_in = f->in_end - f->in_pos;
+      f->z.next_out = (byte *) out;
+      f->z.avail_out = size;
+      err = inflate(&f->z, Z_NO_FLUSH);
+      f->in_pos = f->in_end - f->z.avail_in;
+      n = size - f->z.avail_out;
+      if (err == Z_STREAM_END)
+	{
+	  /* Multiple gzip members are concatenated */
+	  inflateReset(&f->z);
+	  if (n)
+	    return n;
+	}
+      else if (err != Z_OK && err != Z_BUF_ERROR)
+	{
+	  f->err = f->z.msg ? f->z.msg : zError(err);
+	  return -1;
+	}
+      else if (n)
+	return n;
+    }
+}
+
+#endif
+
+#ifdef PCI_HAVE_ZSTD
+
+static int
+id_file_unzstd(struct id_file *f, char *out, unsigned int size)
+{
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer o;
+  size_t ret;
+  int n;
+
+  for (;;)
+    {
+      if ((n = id_file_read_in(f)) <= 0)
+	return n;
+      in.src = f->in;
+      in.size = f->in_end;
+      in.pos = f->in_pos;
+      o.dst = out;
+      o.size = size;
+      o.pos = 0;
+      ret = ZSTD_decompressStream(f->zstd, &o, &in);
+      if (ZSTD_isError(ret))
+	{
+	  f->err = ZSTD_getErrorName(ret);
+	  return -1;
+	}
+      f->in_pos = in.pos;
+      if (o.pos)
+	return o.pos;
+    }
+}
+
+#endif
+
+/* Append more data to the buffer; returns 0 at EOF, -1 on error */
+static int
+id_file_fill(struct id_file *f)
+{
+  unsigned int size;
+  char *out;
+
+  if (f->buf_pos)
+    {
+      memmove(f->buf, f->buf + f->buf_pos, f->buf_end - f->buf_pos);
+      f->buf_end -= f->buf_pos;
+      f->buf_pos = 0;
+    }
+  out = f->buf + f->buf_end;
+  size = ID_FILE_BUFSIZE - f->buf_end;
+
+  switch (f->format)
+    {
+#ifdef PCI_COMPRESSED_IDS
+    case ID_FILE_GZIP:
+      return id_file_inflate(f, out, size);
+#endif
+#ifdef PCI_HAVE_ZSTD
+    case ID_FILE_ZSTD:
+      return id_file_unzstd(f, out, size);
+#endif
+    default:
+      return id_file_read(f, out, size);
+    }
+}
+
+/*
+ *  Returns the next line without the newline character, terminated by a zero
+ *  byte, or NULL at the end of file or on error. The line stays valid until
+ *  the next call.
+ */
+static char *
+id_file_gets(struct id_file *f)
+{
+  char *start, *nl;
+  int n;
+
+  for (;;)
+    {
+      start = f->buf + f->buf_pos;
+      if (nl = memchr(start, '\n', f->buf_end - f->buf_pos))
+	break;
+      if (f->eof || f->buf_end - f->buf_pos == ID_FILE_BUFSIZE)
+	{
+	  /* Incomplete last line or a line which does not fit in the buffer */
+	  if (f->buf_pos == f->buf_end)
+	    return NULL;
+	  nl = f->buf + f->buf_end;
+	  break;
+	}
+      n = id_file_fill(f);
+      if (n < 0)
+	return NULL;
+      f->buf_end += n;
+      if (!n)
+	f->eof = 1;
+    }
+
+  *nl = 0;
+  f->line_pos = f->buf_offset;
+  f->line_len = nl - start;
+  n = nl - start + (nl < f->buf + f->buf_end);
+  f->buf_pos += n;
+  f->buf_offset += n;
+  return start;
+}
+
+static int
+id_file_seekable(struct id_file *f)
+{
+  return (f->format == ID_FILE_PLAIN);
+}
+
+static int
+id_file_seek(struct id_file *f, long pos)
+{
+  if (lseek(f->fd, pos, SEEK_SET) < 0)
+    return -1;
+  f->buf_pos = f->buf_end = 0;
+  f->buf_offset = pos;
+  f->eof = 0;
+  return 0;
+}
+
+static void
+id_file_close(struct id_file *f)
+{
+#ifdef PCI_COMPRESSED_IDS
+  if (f->format == ID_FILE_GZIP)
+    inflateEnd(&f->z);
+#endif
+#ifdef PCI_HAVE_ZSTD
+  if (f->format == ID_FILE_ZSTD)
+    ZSTD_freeDCtx(f->zstd);
+#endif
+  if (f->fd >= 0)
+    close(f->fd);
+  pci_mfree(f->in);
+#ifdef PCI_HAVE_MMAP
+  if (f->mapped)
+    munmap(f->buf, f->mapped);
+  else
+#endif
+    pci_mfree(f->buf);
+  pci_mfree(f);
+}
+
+static struct id_file *
+id_file_open(struct pci_access *a)
+{
+  struct id_file *f;
+  byte *m;
+  int fd, n;
+
+  fd = open(a->id_file_name, O_RDONLY | O_BINARY);
+#ifdef PCI_COMPRESSED_IDS
+  if (fd < 0)
+    {
+      /* Try the name without the .gz suffix */
+      size_t len = strlen(a->id_file_name);
+      char *new_name;
+      if (len < 3 || memcmp(a->id_file_name + len - 3, ".gz", 3) != 0)
+	return NULL;
+      new_name = malloc(len - 2);
+      memcpy(new_name, a->id_file_name, len - 3);
+      new_name[len - 3] = 0;
+      pci_set_name_list_path(a, new_name, 1);
+      fd = open(a->id_file_name, O_RDONLY | O_BINARY);
+    }
+#endif
+  if (fd < 0)
+    return NULL;
+
+  f = pci_malloc(a, sizeof(*f));
+  memset(f, 0, sizeof(*f));
+  f->fd = fd;
+  f->buf = pci_malloc(a, ID_FILE_BUFSIZE + 1);
+
+  /* Read the first block and look at the magic bytes */
+  n = id_file_read(f, f->buf, ID_FILE_BUFSIZE);
+  if (n <= 0)
+    {
+      f->eof = 1;
+      return f;
+    }
+  m = (byte *) f->buf;
+  if (n >= 2 && m[0] == 0x1f && m[1] == 0x8b)
+    f->format = ID_FILE_GZIP;
+  else if (n >= 4 && m[0] == 0x28 && m[1] == 0xb5 && m[2] == 0x2f && m[3] == 0xfd)
+    f->format = ID_FILE_ZSTD;
+  else
+    {
+      f->buf_end = n;
+      return f;
+    }
+
+  f->in = pci_malloc(a, ID_FILE_BUFSIZE);
+  memcpy(f->in, f->buf, n);
+  f->in_end = n;
+  switch (f->format)
+    {
+#ifdef PCI_COMPRESSED_IDS
+    case ID_FILE_GZIP:
+      if (inflateInit2(&f->z, 16 + MAX_WBITS) != Z_OK)
+	f->err = "Cannot initialize decompression";
+      break;
+#endif
+#ifdef PCI_HAVE_ZSTD
+    case ID_FILE_ZSTD:
+      if (!(f->zstd = ZSTD_createDCtx()))
+	f->err = "Cannot initialize decompression";
+      break;
 #endif
+    default:
+      f->err = "Compressed ID list not supported";
+    }
+  if (f->err)
+    {
+      f->format = ID_FILE_PLAIN;
+      f->eof = 1;
+    }
+  return f;
+}
+
+/*
+ *  Make the buffer of an uncompressed file contain the whole file. We map it
+ *  privately, so that lines can be terminated in place; if it ends exactly
+ *  at a page boundary without a newline, there is no room for the zero byte
+ *  after the last line and we read the file to memory instead.
+ */
+static void
+id_file_whole(struct pci_access *a, struct id_file *f)
+{
+  struct stat st;
+  size_t size, pos;
+  char *data;
+  int n;
+
+  if (f->format != ID_FILE_PLAIN || f->err || fstat(f->fd, &st) < 0 || !S_ISREG(st.st_mode))
+    return;
+  size = st.st_size;
+  if (size >= 0x7fffffff)
+    return;
+
+  if (size > f->buf_end)
+    {
+#ifdef PCI_HAVE_MMAP
+      data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, f->fd, 0);
+      if (data != MAP_FAILED)
+	{
+	  if (size % sysconf(_SC_PAGESIZE) || data[size-1] == '\n')
+	    {
+	      pci_mfree(f->buf);
+	      f->buf = data;
+	      f->mapped = size;
+	      goto done;
+	    }
+	  munmap(data, size);
+	}
+#endif
+      data = pci_malloc(a, size + 1);
+      memcpy(data, f->buf, f->buf_end);
+      for (pos = f->buf_end; pos < size; pos += n)
+	if ((n = id_file_read(f, data + pos, size - pos)) <= 0)
+	  {
+	    size = pos;
+	    break;
+	  }
+      pci_mfree(f->buf);
+      f->buf = data;
+    }
+
+done:
+  f->buf_end = size;
+  f->eof = 1;
+  close(f->fd);
+  f->fd = -1;
+}
 
 static int id_hex(char *p, int cnt)
 {
@@ -81,26 +447,76 @@ static inline int id_white_p(int c)
   return (c == ' ') || (c == '\t');
 }
 
+/*
+ *  In the lazy mode, we only scan the file for positions of top-level blocks
+ *  (vendors, classes and generic subsystems) and parse each block when its
+ *  ID is looked up for the first time.
+ */
+
+struct id_block {
+  long pos;				/* Position of the first line of the block */
+  int lino;				/* ... and its line number */
+  u16 id;
+  byte cat;				/* ID_VENDOR, ID_CLASS or ID_GEN_SUBSYSTEM */
+  byte loaded;
+};
+
+struct id_lazy {
+  struct id_file *file;
+  struct id_block *blocks;
+  int num_blocks, max_blocks;
+};
+
+static int
+id_block_cmp(const void *A, const void *B)
+{
+  const struct id_block *a = A, *b = B;
+  if (a->cat != b->cat)
+    return (a->cat < b->cat) ? -1 : 1;
+  if (a->id != b->id)
+    return (a->id < b->id) ? -1 : 1;
+  return a->lino - b->lino;
+}
+
+static struct id_block *
+id_lazy_find(struct id_lazy *l, int cat, int id)
+{
+  int lo = 0, hi = l->num_blocks;
+
+  while (lo < hi)
+    {
+      int m = (lo + hi) / 2;
+      struct id_block *b = &l->blocks[m];
+      if (b->cat == cat && b->id == id)
+	return b;
+      if (b->cat < cat || (b->cat == cat && b->id < id))
+	lo = m + 1;
+      else
+	hi = m;
+    }
+  return NULL;
+}
+
 
-static const char *id_parse_list(struct pci_access *a, pci_file f, int *lino)
+/* If single_block is set, we stop at the start of the next top-level block */
+static const char *id_parse_list(struct pci_access *a, struct id_file *f, int *lino, int single_block)
 {
-  char line[MAX_LINE];
-  char *p;
+  char *line, *p;
   int id1=0, id2=0, id3=0, id4=0;
   int cat = -1;
   int nest;
+  int blocks = 0;
   static const char parse_error[] = "Parse error";
 
-  *lino = 0;
-  while (pci_gets(f, line, sizeof(line)))
+  while (line = id_file_gets(f))
     {
       (*lino)++;
-      p = line;
-      while (*p && *p != '\n' && *p != '\r')
-	p++;
-      if (!*p && !pci_eof(f))
+      if (f->line_len >= MAX_LINE - 1)
 	return "Line too long";
-      *p = 0;
+      if (p = memchr(line, '\r', f->line_len))
+	*p = 0;
+      else
+	p = line + f->line_len;
       if (p > line && (p[-1] == ' ' || p[-1] == '\t'))
 	*--p = 0;
 
@@ -117,6 +533,8 @@ static const char *id_parse_list(struct pci_access *a, pci_file f, int *lino)
 
       if (!nest)					/* Top-level entries */
 	{
+	  if (single_block && blocks++)
+	    break;
 	  if (p[0] == 'C' && p[1] == ' ')		/* Class block */
 	    {
 	      if ((id1 = id_hex(p+2, 2)) < 0 || !id_white_p(p[4]))
@@ -128,7 +546,7 @@ static const char *id_parse_list(struct pci_access *a, pci_file f, int *lino)
 	    {						/* Generic subsystem block */
 	      if ((id1 = id_hex(p+2, 4)) < 0 || p[6])
 		return parse_error;
-	      if (!pci_id_lookup(a, 0, ID_VENDOR, id1, 0, 0, 0))
+	      if (a->id_db->lazy ? !id_lazy_find(a->id_db->lazy, ID_VENDOR, id1) : !pci_id_lookup(a, 0, ID_VENDOR, id1, 0, 0, 0))
 		return "Vendor does not exist";
 	      cat = ID_GEN_SUBSYSTEM;
 	      continue;
@@ -213,33 +631,334 @@ static const char *id_parse_list(struct pci_access *a, pci_file f, int *lino)
   return NULL;
 }
 
-int
-pci_load_name_list(struct pci_access *a)
+static int
+id_load_file(struct pci_access *a, int publish)
 {
-  pci_file f;
+  struct id_file *f;
   int lino;
   const char *err;
 
-  pci_free_name_list(a);
-  a->id_load_failed = 1;
-  if (!(f = pci_open(a)))
+  if (!(f = id_file_open(a)))
+    return 0;
+  id_file_whole(a, f);
+  lino = 0;
+  err = id_parse_list(a, f, &lino, 0);
+  if (!err)
+    err = f->err;
+  id_file_close(f);
+  if (err)
+    a->error("%s at %s, line %d\n", err, a->id_file_name, lino);
+  else if (publish)
+    pci_id_shm_publish(a);
+  pci_id_strings_stats(a);
+  pci_id_strings_drop(a);
+  return 1;
+}
+
+static const char *
+id_scan_blocks(struct pci_access *a, struct id_lazy *l, int *lino)
+{
+  char *line, *p;
+  int cat, id;
+  static const char parse_error[] = "Parse error";
+
+  while (line = id_file_gets(l->file))
+    {
+      (*lino)++;
+      if (l->file->line_len >= MAX_LINE - 1)
+	return "Line too long";
+
+      p = line;
+      while (id_white_p(*p))
+	p++;
+      if (line[0] == '\t' || !*p || *p == '#' || *p == '\r')
+	continue;
+
+      p = line;
+      if (p[0] == 'C' && p[1] == ' ')
+	{
+	  if ((id = id_hex(p+2, 2)) < 0 || !id_white_p(p[4]))
+	    return parse_error;
+	  cat = ID_CLASS;
+	}
+      else if (p[0] == 'S' && p[1] == ' ')
+	{
+	  if ((id = id_hex(p+2, 4)) < 0)
+	    return parse_error;
+	  cat = ID_GEN_SUBSYSTEM;
+	}
+      else if (p[0] >= 'A' && p[0] <= 'Z' && p[1] == ' ')
+	continue;
+      else
+	{
+	  if ((id = id_hex(p, 4)) < 0 || !id_white_p(p[4]))
+	    return parse_error;
+	  cat = ID_VENDOR;
+	}
+
+      if (l->num_blocks >= l->max_blocks)
+	{
+	  struct id_block *old = l->blocks;
+	  l->max_blocks = 2 * l->max_blocks + 256;
+	  l->blocks = pci_malloc(a, l->max_blocks * sizeof(struct id_block));
+	  if (old)
+	    memcpy(l->blocks, old, l->num_blocks * sizeof(struct id_block));
+	  pci_mfree(old);
+	}
+      l->blocks[l->num_blocks].pos = l->file->line_pos;
+      l->blocks[l->num_blocks].lino = *lino;
+      l->blocks[l->num_blocks].id = id;
+      l->blocks[l->num_blocks].cat = cat;
+      l->blocks[l->num_blocks].loaded = 0;
+      l->num_blocks++;
+    }
+  return NULL;
+}
+
+static void
+id_lazy_free(struct pci_access *a)
+{
+  struct id_lazy *l = a->id_db->lazy;
+
+  if (l)
+    {
+      id_file_close(l->file);
+      pci_mfree(l->blocks);
+      pci_mfree(l);
+      a->id_db->lazy = NULL;
+    }
+}
+
+static int
+id_load_lazy(struct pci_access *a)
+{
+  struct id_lazy *l;
+  struct id_file *f;
+  int i, lino;
+  const char *err;
+
+  if (!(f = id_file_open(a)))
     return 0;
-  err = id_parse_list(a, f, &lino);
-  PCI_ERROR(f, err);
-  pci_close(f);
+  if (!id_file_seekable(f))
+    {
+      a->debug("Cannot load %s lazily, since it is compressed\n", a->id_file_name);
+      id_file_close(f);
+      return id_load_file(a, 0);
+    }
+
+  l = pci_malloc(a, sizeof(*l));
+  memset(l, 0, sizeof(*l));
+  l->file = f;
+  lino = 0;
+  err = id_scan_blocks(a, l, &lino);
+  if (!err)
+    err = f->err;
+  if (!err)
+    {
+      qsort(l->blocks, l->num_blocks, sizeof(struct id_block), id_block_cmp);
+      for (i=1; i<l->num_blocks; i++)
+	if (l->blocks[i-1].cat == l->blocks[i].cat && l->blocks[i-1].id == l->blocks[i].id)
+	  {
+	    err = "Duplicate entry";
+	    lino = l->blocks[i].lino;
+	    break;
+	  }
+    }
+  a->id_db->lazy = l;
   if (err)
     a->error("%s at %s, line %d\n", err, a->id_file_name, lino);
-  a->id_load_failed = 0;
+  a->debug("Loading %s lazily (%d blocks)\n", a->id_file_name, l->num_blocks);
   return 1;
 }
 
+static struct id_block *
+id_lazy_block(struct id_lazy *l, int cat, int id1)
+{
+  switch (cat)
+    {
+    case ID_VENDOR:
+    case ID_DEVICE:
+    case ID_SUBSYSTEM:
+      return id_lazy_find(l, ID_VENDOR, id1);
+    case ID_GEN_SUBSYSTEM:
+      return id_lazy_find(l, ID_GEN_SUBSYSTEM, id1);
+    case ID_CLASS:
+    case ID_SUBCLASS:
+    case ID_PROGIF:
+      return id_lazy_find(l, ID_CLASS, id1);
+    default:
+      return NULL;
+    }
+}
+
+/* Blocks are loaded under the lock, but their flags are tested without it */
+static inline int
+id_block_loaded(struct id_block *b)
+{
+#ifdef PCI_HAVE_PTHREAD
+  return __atomic_load_n(&b->loaded, __ATOMIC_ACQUIRE);
+#else
+  return b->loaded;
+#endif
+}
+
+int
+pci_id_lazy_loaded(struct pci_access *a, int cat, int id1)
+{
+  struct id_block *b = id_lazy_block(a->id_db->lazy, cat, id1);
+
+  return !b || id_block_loaded(b);
+}
+
+/* Must be called with the database locked */
 void
-pci_free_name_list(struct pci_access *a)
+pci_id_lazy_load(struct pci_access *a, int cat, int id1)
+{
+  struct id_lazy *l = a->id_db->lazy;
+  struct id_block *b;
+  const char *err;
+  int lino;
+
+  b = id_lazy_block(l, cat, id1);
+  if (!b || b->loaded)
+    return;
+
+  lino = b->lino - 1;
+  if (id_file_seek(l->file, b->pos) < 0)
+    err = "Seek error";
+  else
+    err = id_parse_list(a, l->file, &lino, 1);
+  pci_id_strings_drop(a);
+  if (!err)
+    err = l->file->err;
+#ifdef PCI_HAVE_PTHREAD
+  __atomic_store_n(&b->loaded, 1, __ATOMIC_RELEASE);
+#else
+  b->loaded = 1;
+#endif
+  if (err)
+    a->error("%s at %s, line %d\n", err, a->id_file_name, lino);
+}
+
+/* Must be called with the database locked */
+void
+pci_id_lazy_load_all(struct pci_access *a)
+{
+  struct id_lazy *l = a->id_db->lazy;
+  int i;
+
+  for (i=0; i<l->num_blocks; i++)
+    pci_id_lazy_load(a, l->blocks[i].cat, l->blocks[i].id);
+}
+
+/*
+ *  The name database is reference counted, so that it can be shared by
+ *  multiple accesses. pci_free_name_list() and pci_cleanup() only drop
+ *  the reference; the last one frees the database. On the other hand,
+ *  (re)loading of the list replaces the contents for all its users.
+ */
+
+static struct id_db *
+id_db_alloc(void)
+{
+  struct id_db *db = malloc(sizeof(struct id_db));
+
+  memset(db, 0, sizeof(*db));
+  db->refcnt = 1;
+  pci_id_db_lock_init(db);
+  return db;
+}
+
+static void
+id_db_clear(struct pci_access *a)
 {
   pci_id_cache_flush(a);
+  pci_id_search_free(a);
   pci_id_hash_free(a);
+  pci_id_index_free(a);
+  id_lazy_free(a);
   pci_id_hwdb_free(a);
-  a->id_load_failed = 0;
+  a->id_db->load_failed = 0;
+  pci_id_set_loaded(a, 0);
+}
+
+void
+pci_id_db_init(struct pci_access *a)
+{
+  a->id_db = id_db_alloc();
+}
+
+void
+pci_id_db_cleanup(struct pci_access *a)
+{
+  if (!--a->id_db->refcnt)
+    {
+      id_db_clear(a);
+      pci_id_db_lock_cleanup(a->id_db);
+      pci_mfree(a->id_db);
+    }
+  a->id_db = NULL;
+}
+
+void
+pci_free_name_list(struct pci_access *a)
+{
+  if (a->id_db->refcnt > 1)
+    {
+      a->id_db->refcnt--;
+      a->id_db = id_db_alloc();
+    }
+  else
+    id_db_clear(a);
+}
+
+void
+pci_share_name_list(struct pci_access *a, struct pci_access *from)
+{
+  if (a->id_db == from->id_db)
+    return;
+  pci_id_db_cleanup(a);
+  a->id_db = from->id_db;
+  a->id_db->refcnt++;
+}
+
+int
+pci_load_name_list(struct pci_access *a)
+{
+  char *lazy, *shm;
+  int ok;
+
+  id_db_clear(a);
+  a->id_db->load_failed = 1;
+  lazy = pci_get_param(a, "names.lazy");
+  shm = pci_get_param(a, "names.shm");
+  if (pci_id_index_load(a))
+    ok = 1;
+  else if (shm && atoi(shm))
+    ok = pci_id_shm_attach(a) || id_load_file(a, 1);
+  else if (lazy && atoi(lazy))
+    ok = id_load_lazy(a);
+  else
+    ok = id_load_file(a, 0);
+  if (!ok)
+    return 0;
+  a->id_db->load_failed = 0;
+  return 1;
+}
+
+int
+pci_compile_name_list(struct pci_access *a, char *index_name)
+{
+  char namebuf[MAX_LINE];
+
+  id_db_clear(a);
+  a->id_db->load_failed = 1;
+  if (!id_load_file(a, 0))
+    return 0;
+  a->id_db->load_failed = 0;
+  if (!index_name && !(index_name = pci_id_index_name(a, namebuf, sizeof(namebuf))))
+    return 0;
+  return pci_id_index_write(a, index_name);
 }
 
 void
@@ -0,0 +1,334 @@
+/*
+ *	The PCI Library -- Searching for ID's by Name
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+#include "names.h"
+
+/*
+ *  The search index is built on the first query from the local entries
+ *  (either those in the hash or those in the binary index) and it lives
+ *  as long as the ID list. For every trigram of a lower-cased name, it
+ *  keeps a list of entries whose names contain the trigram; trigrams are
+ *  hashed to a fixed number of buckets, so the lists can contain false
+ *  positives. A query walks the shortest list among the trigrams of the
+ *  pattern and checks the candidates. Patterns shorter than a trigram
+ *  are matched against all entries.
+ */
+
+#define SEARCH_HASH_BITS 16
+#define SEARCH_HASH_SIZE (1 << SEARCH_HASH_BITS)
+
+struct id_search {
+  struct id_entry *entries;		/* Sorted by (cat, id12, id34) */
+  u32 num_entries;
+  u32 *starts;				/* Bucket i owns postings[starts[i]] to postings[starts[i+1]-1] */
+  u32 *postings;			/* Entry numbers in increasing order */
+};
+
+static inline int
+id_search_lower(int c)
+{
+  return (c >= 'A' && c <= 'Z') ? c + 'a' - 'A' : c;
+}
+
+static inline unsigned int
+id_trigram(const char *s)
+{
+  u32 t = (id_search_lower((byte) s[0]) << 16) | (id_search_lower((byte) s[1]) << 8) | id_search_lower((byte) s[2]);
+  return (t * 0x9e3779b1) >> (32 - SEARCH_HASH_BITS);
+}
+
+static int
+id_search_cat_p(int cat)
+{
+  return (cat == ID_VENDOR || cat == ID_DEVICE || cat == ID_CLASS || cat == ID_SUBCLASS || cat == ID_PROGIF);
+}
+
+static int
+id_search_entry_cmp(const void *A, const void *B)
+{
+  const struct id_entry *a = A, *b = B;
+  if (a->cat != b->cat)
+    return (a->cat < b->cat) ? -1 : 1;
+  if (a->id12 != b->id12)
+    return (a->id12 < b->id12) ? -1 : 1;
+  if (a->id34 != b->id34)
+    return (a->id34 < b->id34) ? -1 : 1;
+  return 0;
+}
+
+/* Collects the searchable entries from the binary index or from the hash */
+static u32
+id_search_collect(struct pci_access *a, struct id_entry *out)
+{
+  struct id_db *db = a->id_db;
+  u32 i, n = 0;
+
+  if (db->index)
+    {
+      struct id_index_entry *ie;
+      char *strings;
+      u32 num, strings_size;
+      ie = pci_id_index_entries(a, &num, &strings, &strings_size);
+      for (i=0; i<num; i++)
+	if (id_search_cat_p(ie[i].cat) && ie[i].name < strings_size)
+	  {
+	    if (out)
+	      {
+		out[n].cat = ie[i].cat;
+		out[n].id12 = ie[i].id12;
+		out[n].id34 = ie[i].id34;
+		out[n].name = strings + ie[i].name;
+	      }
+	    n++;
+	  }
+    }
+  else
+    {
+      struct id_entry *e;
+      unsigned int pos = 0;
+      while (e = pci_id_walk(a, &pos))
+	if (id_search_cat_p(e->cat) && e->src == SRC_LOCAL)
+	  {
+	    if (out)
+	      out[n] = *e;
+	    n++;
+	  }
+    }
+
+  /* Without the ID list, the embedded one is searched */
+  if (!n)
+    {
+      const struct id_index_entry *ie;
+      const char *names;
+      u32 num;
+      ie = pci_id_embedded_entries(&num, &names);
+      for (i=0; i<num; i++)
+	if (id_search_cat_p(ie[i].cat))
+	  {
+	    if (out)
+	      {
+		out[n].cat = ie[i].cat;
+		out[n].id12 = ie[i].id12;
+		out[n].id34 = ie[i].id34;
+		out[n].name = (char *) names + ie[i].name;
+	      }
+	    n++;
+	  }
+    }
+  return n;
+}
+
+/* Calls f(s, bucket, entry) for every distinct bucket among trigrams of the entry's name */
+static void
+id_search_scan(struct id_search *s, u32 *last, void (*f)(struct id_search *s, unsigned int bucket, u32 entry))
+{
+  u32 i;
+  char *p;
+
+  for (i=0; i<s->num_entries; i++)
+    for (p = s->entries[i].name; p[0] && p[1] && p[2]; p++)
+      {
+	unsigned int h = id_trigram(p);
+	if (last[h] != i)
+	  {
+	    last[h] = i;
+	    f(s, h, i);
+	  }
+      }
+}
+
+static void
+id_search_count(struct id_search *s, unsigned int bucket, u32 entry UNUSED)
+{
+  s->starts[bucket+1]++;
+}
+
+static void
+id_search_add(struct id_search *s, unsigned int bucket, u32 entry)
+{
+  s->postings[s->starts[bucket]++] = entry;
+}
+
+static struct id_search *
+id_search_build(struct pci_access *a)
+{
+  struct id_search *s;
+  u32 *last;
+  unsigned int i;
+
+  if (a->id_db->lazy)
+    pci_id_lazy_load_all(a);
+
+  s = pci_malloc(a, sizeof(*s));
+  s->num_entries = id_search_collect(a, NULL);
+  s->entries = pci_malloc(a, s->num_entries * sizeof(struct id_entry) + 1);
+  id_search_collect(a, s->entries);
+  qsort(s->entries, s->num_entries, sizeof(struct id_entry), id_search_entry_cmp);
+
+  /* Counting pass, then the postings are filled in with starts[] shifted by one bucket */
+  last = pci_malloc(a, SEARCH_HASH_SIZE * sizeof(u32));
+  s->starts = pci_malloc(a, (SEARCH_HASH_SIZE + 1) * sizeof(u32));
+  memset(s->starts, 0, (SEARCH_HASH_SIZE + 1) * sizeof(u32));
+  memset(last, 0xff, SEARCH_HASH_SIZE * sizeof(u32));
+  id_search_scan(s, last, id_search_count);
+  for (i=0; i<SEARCH_HASH_SIZE; i++)
+    s->starts[i+1] += s->starts[i];
+  s->postings = pci_malloc(a, s->starts[SEARCH_HASH_SIZE] * sizeof(u32) + 1);
+  memset(last, 0xff, SEARCH_HASH_SIZE * sizeof(u32));
+  id_search_scan(s, last, id_search_add);
+  for (i=SEARCH_HASH_SIZE; i>0; i--)
+    s->starts[i] = s->starts[i-1];
+  s->starts[0] = 0;
+  pci_mfree(last);
+
+  a->debug("Built search index of %u names (%u postings)\n", s->num_entries, s->starts[SEARCH_HASH_SIZE]);
+  return s;
+}
+
+void
+pci_id_search_free(struct pci_access *a)
+{
+  struct id_search *s = a->id_db->search;
+
+  if (s)
+    {
+      pci_mfree(s->entries);
+      pci_mfree(s->starts);
+      pci_mfree(s->postings);
+      pci_mfree(s);
+      a->id_db->search = NULL;
+    }
+}
+
+/* Case-insensitive substring test, the pattern is already lower-cased */
+static int
+id_search_contains(const char *name, const char *pat, int len)
+{
+  int i;
+
+  for (; *name; name++)
+    {
+      for (i=0; i<len && id_search_lower((byte) name[i]) == pat[i]; i++)
+	;
+      if (i == len)
+	return 1;
+    }
+  return 0;
+}
+
+static int
+id_search_wanted(struct id_entry *e, int flags)
+{
+  switch (e->cat)
+    {
+    case ID_VENDOR:
+      return flags & PCI_LOOKUP_VENDOR;
+    case ID_DEVICE:
+      return flags & PCI_LOOKUP_DEVICE;
+    case ID_CLASS:
+    case ID_SUBCLASS:
+      return flags & PCI_LOOKUP_CLASS;
+    case ID_PROGIF:
+      return flags & PCI_LOOKUP_PROGIF;
+    default:
+      return 0;
+    }
+}
+
+static void
+id_search_fill(struct pci_id_match *m, struct id_entry *e)
+{
+  unsigned int id1 = pair_first(e->id12), id2 = pair_second(e->id12);
+
+  m->vendor = m->device = m->device_class = m->prog_if = -1;
+  m->class_mask = 0;
+  m->name = e->name;
+  switch (e->cat)
+    {
+    case ID_VENDOR:
+      m->flags = PCI_LOOKUP_VENDOR;
+      m->vendor = id1;
+      break;
+    case ID_DEVICE:
+      m->flags = PCI_LOOKUP_DEVICE;
+      m->vendor = id1;
+      m->device = id2;
+      break;
+    case ID_CLASS:
+      m->flags = PCI_LOOKUP_CLASS;
+      m->device_class = id1 << 8;
+      m->class_mask = 0xff00;
+      break;
+    case ID_SUBCLASS:
+      m->flags = PCI_LOOKUP_CLASS;
+      m->device_class = (id1 << 8) | id2;
+      m->class_mask = 0xffff;
+      break;
+    case ID_PROGIF:
+      m->flags = PCI_LOOKUP_PROGIF;
+      m->device_class = (id1 << 8) | id2;
+      m->class_mask = 0xffff;
+      m->prog_if = pair_first(e->id34);
+      break;
+    }
+}
+
+/* Must be called with the database locked */
+int
+pci_id_search(struct pci_access *a, int flags, char *pattern, struct pci_id_match *m, int max)
+{
+  struct id_search *s;
+  char pat[MAX_LINE];
+  unsigned int len, i;
+  int n;
+  u32 j, first, last, *list;
+
+  if (!(flags & (PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_CLASS | PCI_LOOKUP_PROGIF)))
+    flags |= PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_CLASS | PCI_LOOKUP_PROGIF;
+  len = strlen(pattern);
+  if (!len || len >= MAX_LINE)
+    return 0;
+  for (i=0; i<len; i++)
+    pat[i] = id_search_lower((byte) pattern[i]);
+  pat[len] = 0;
+
+  if (!(s = a->id_db->search))
+    s = a->id_db->search = id_search_build(a);
+
+  /* Pick the shortest list of candidates */
+  list = NULL;
+  first = 0;
+  last = s->num_entries;
+  for (i=0; i+3 <= len; i++)
+    {
+      unsigned int h = id_trigram(pat + i);
+      if (!list || s->starts[h+1] - s->starts[h] < last - first)
+	{
+	  list = s->postings;
+	  first = s->starts[h];
+	  last = s->starts[h+1];
+	}
+    }
+
+  n = 0;
+  for (j=first; j<last; j++)
+    {
+      struct id_entry *e = &s->entries[list ? list[j] : j];
+      if (id_search_wanted(e, flags) && id_search_contains(e->name, pat, len))
+	{
+	  if (n < max)
+	    id_search_fill(&m[n], e);
+	  n++;
+	}
+    }
+  return n;
+}
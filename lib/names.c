@@ -7,43 +7,125 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <time.h>
 
 #include "internal.h"
 #include "names.h"
 
-static char *id_lookup(struct pci_access *a, int flags, int cat, int id1, int id2, int id3, int id4)
+static void
+id_net_defer(struct pci_access *a, struct id_net_batch *b, int cat, int id1, int id2, int id3, int id4)
+{
+  struct id_net_query *q;
+  int i;
+
+  b->deferred = 1;
+  for (i=0; i<b->count; i++)
+    {
+      q = &b->queries[i];
+      if (q->cat == cat && q->id1 == id1 && q->id2 == id2 && q->id3 == id3 && q->id4 == id4)
+	return;
+    }
+  if (b->count >= b->max)
+    {
+      q = b->queries;
+      b->max = 2*b->max + 64;
+      b->queries = pci_malloc(a, b->max * sizeof(struct id_net_query));
+      if (q)
+	memcpy(b->queries, q, b->count * sizeof(struct id_net_query));
+      pci_mfree(q);
+    }
+  q = &b->queries[b->count++];
+  q->cat = cat;
+  q->id1 = id1;
+  q->id2 = id2;
+  q->id3 = id3;
+  q->id4 = id4;
+}
+
+static inline int
+id_net_deferred(struct id_net_batch *b)
+{
+  return b && b->deferred;
+}
+
+/* Remember the result of a DNS query, failures included */
+static void
+id_net_insert(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *name, unsigned int ttl)
+{
+  u32 expires = 0;
+
+  if (ttl)
+    {
+      time_t t = time(NULL) + ttl;
+      expires = (t > 0 && t < 0xffffffff) ? t : 0xffffffff;
+    }
+  pci_id_insert_expiring(a, cat, id1, id2, id3, id4, name ? name : "", SRC_NET, expires);
+  if (name || expires)
+    pci_id_cache_dirty(a);
+  pci_mfree(name);
+}
+
+static void
+id_load_list(struct pci_access *a, int flags)
+{
+  if (!pci_id_loaded(a) && !(flags & (PCI_LOOKUP_NUMERIC | PCI_LOOKUP_SKIP_LOCAL)))
+    {
+      pci_id_lock(a);
+      if (!a->id_db->loaded)
+	{
+	  if (!a->id_db->hash && !a->id_db->index && !a->id_db->lazy && !a->id_db->load_failed)
+	    pci_load_name_list(a);
+	  pci_id_set_loaded(a, 1);
+	}
+      pci_id_unlock(a);
+    }
+}
+
+/* The slow path of id_lookup(), called with the database locked */
+static char *id_lookup_locked(struct pci_access *a, struct id_net_batch *b, int flags, int cat, int id1, int id2, int id3, int id4)
 {
   char *name;
   int tried_hwdb = 0;
+  unsigned int ttl;
+
+  if (a->id_db->lazy && !(flags & PCI_LOOKUP_SKIP_LOCAL))
+    pci_id_lazy_load(a, cat, id1);
 
   while (!(name = pci_id_lookup(a, flags, cat, id1, id2, id3, id4)))
     {
-      if ((flags & PCI_LOOKUP_CACHE) && !a->id_cache_status)
+      if ((flags & PCI_LOOKUP_CACHE) && !a->id_db->cache_status)
 	{
 	  if (pci_id_cache_load(a, flags))
 	    continue;
 	}
-      if (!tried_hwdb && !(flags & (PCI_LOOKUP_SKIP_LOCAL | PCI_LOOKUP_NO_HWDB)))
+      if (!tried_hwdb && !(flags & (PCI_LOOKUP_SKIP_LOCAL | PCI_LOOKUP_NO_HWDB)) &&
+	  pci_id_source(a, cat, id1, id2, id3, id4) != SRC_HWDB_MISS)
 	{
 	  tried_hwdb = 1;
 	  if (name = pci_id_hwdb_lookup(a, cat, id1, id2, id3, id4))
 	    {
 	      pci_id_insert(a, cat, id1, id2, id3, id4, name, SRC_HWDB);
+	      pci_mfree(name);
 	      continue;
 	    }
+	  /* Remember the miss, so that we do not ask again */
+	  pci_id_insert(a, cat, id1, id2, id3, id4, "", SRC_HWDB_MISS);
 	}
       if (flags & PCI_LOOKUP_NETWORK)
         {
-	  if (name = pci_id_net_lookup(a, cat, id1, id2, id3, id4))
+	  if (b)
 	    {
-	      pci_id_insert(a, cat, id1, id2, id3, id4, name, SRC_NET);
-	      pci_mfree(name);
-	      pci_id_cache_dirty(a);
+	      id_net_defer(a, b, cat, id1, id2, id3, id4);
+	      return NULL;
 	    }
-	  else
-	    pci_id_insert(a, cat, id1, id2, id3, id4, "", SRC_NET);
+	  /* Do not block other threads while waiting for the DNS */
+	  pci_id_unlock(a);
+	  name = pci_id_net_lookup(a, cat, id1, id2, id3, id4, &ttl);
+	  pci_id_lock(a);
+	  id_net_insert(a, cat, id1, id2, id3, id4, name, ttl);
 	  /* We want to iterate the lookup to get the allocated ID entry from the hash */
 	  continue;
 	}
@@ -52,33 +134,119 @@ static char *id_lookup(struct pci_access *a, int flags, int cat, int id1, int id
   return (name[0] ? name : NULL);
 }
 
+/*
+ *  Once the list is loaded, names which are already known (and whose block
+ *  has been parsed in the lazy mode) are looked up without locking. Everything
+ *  else, including all sources which modify the database, goes through the lock.
+ */
+static char *id_lookup(struct pci_access *a, struct id_net_batch *b, int flags, int cat, int id1, int id2, int id3, int id4)
+{
+  char *name;
+
+  if (b)
+    b->deferred = 0;
+  if (!pci_id_loaded(a))
+    {
+      /* Names in the embedded list need no loading */
+      if (!(flags & PCI_LOOKUP_SKIP_LOCAL) && (name = pci_id_embedded_lookup(cat, id1, id2, id3, id4)))
+	return name;
+      id_load_list(a, flags);
+    }
+  if (pci_id_loaded(a) &&
+      (!a->id_db->lazy || (flags & PCI_LOOKUP_SKIP_LOCAL) || pci_id_lazy_loaded(a, cat, id1)))
+    {
+      if (name = pci_id_lookup(a, flags, cat, id1, id2, id3, id4))
+	return (name[0] ? name : NULL);
+      /* Neither do misses which id_lookup_locked() would not try to resolve */
+      if (!(flags & PCI_LOOKUP_NETWORK) &&
+	  (!(flags & PCI_LOOKUP_CACHE) || ID_LOAD(a->id_db->cache_status)) &&
+	  ((flags & (PCI_LOOKUP_SKIP_LOCAL | PCI_LOOKUP_NO_HWDB)) ||
+	   pci_id_source(a, cat, id1, id2, id3, id4) == SRC_HWDB_MISS))
+	return NULL;
+    }
+
+  pci_id_lock(a);
+  name = id_lookup_locked(a, b, flags, cat, id1, id2, id3, id4);
+  pci_id_unlock(a);
+  return name;
+}
+
 static char *
-id_lookup_subsys(struct pci_access *a, int flags, int iv, int id, int isv, int isd)
+id_lookup_subsys(struct pci_access *a, struct id_net_batch *b, int flags, int iv, int id, int isv, int isd)
 {
   char *d = NULL;
   if (iv > 0 && id > 0)						/* Per-device lookup */
-    d = id_lookup(a, flags, ID_SUBSYSTEM, iv, id, isv, isd);
-  if (!d)							/* Generic lookup */
-    d = id_lookup(a, flags, ID_GEN_SUBSYSTEM, isv, isd, 0, 0);
-  if (!d && iv == isv && id == isd)				/* Check for subsystem == device */
-    d = id_lookup(a, flags, ID_DEVICE, iv, id, 0, 0);
+    d = id_lookup(a, b, flags, ID_SUBSYSTEM, iv, id, isv, isd);
+  if (!d && !id_net_deferred(b))				/* Generic lookup */
+    d = id_lookup(a, b, flags, ID_GEN_SUBSYSTEM, isv, isd, 0, 0);
+  if (!d && !id_net_deferred(b) && iv == isv && id == isd)				/* Check for subsystem == device */
+    d = id_lookup(a, b, flags, ID_DEVICE, iv, id, 0, 0);
   return d;
 }
 
+/*
+ *  When looking up multiple names at once, the same ID's are frequently
+ *  asked for repeatedly (e.g., the vendor in VENDOR, VENDOR|DEVICE and
+ *  SUBSYSTEM|VENDOR requests), so we remember a couple of recent results.
+ *  ID_SUBSYSTEM_ANY stands for the result of id_lookup_subsys().
+ *
+ *  The memo also carries the DNS batch during the dry run of
+ *  id_net_prefetch(); results are not remembered then, since they
+ *  are only provisional.
+ */
+
+#define ID_SUBSYSTEM_ANY 0xff
+#define MEMO_SIZE 8
+
+struct lookup_memo {
+  struct {
+    int flags, cat;
+    int id1, id2, id3, id4;
+    char *name;
+  } e[MEMO_SIZE];
+  int count, next;
+  struct id_net_batch *batch;
+};
+
 static char *
-format_name(char *buf, int size, int flags, char *name, char *num, char *unknown)
+memo_lookup(struct pci_access *a, struct lookup_memo *m, int flags, int cat, int id1, int id2, int id3, int id4)
 {
-  int res;
-  if ((flags & PCI_LOOKUP_NO_NUMBERS) && !name)
-    return NULL;
-  else if (flags & PCI_LOOKUP_NUMERIC)
-    res = snprintf(buf, size, "%s", num);
-  else if (!name)
-    res = snprintf(buf, size, ((flags & PCI_LOOKUP_MIXED) ? "%s [%s]" : "%s %s"), unknown, num);
-  else if (!(flags & PCI_LOOKUP_MIXED))
-    res = snprintf(buf, size, "%s", name);
+  struct id_net_batch *b = m ? m->batch : NULL;
+  char *name;
+  int i;
+
+  flags &= ~0xffff;
+  if (m && !b)
+    for (i=0; i<m->count; i++)
+      if (m->e[i].cat == cat && m->e[i].flags == flags &&
+	  m->e[i].id1 == id1 && m->e[i].id2 == id2 && m->e[i].id3 == id3 && m->e[i].id4 == id4)
+	return m->e[i].name;
+
+  if (cat == ID_SUBSYSTEM_ANY)
+    name = id_lookup_subsys(a, b, flags, id1, id2, id3, id4);
   else
-    res = snprintf(buf, size, "%s [%s]", name, num);
+    name = id_lookup(a, b, flags, cat, id1, id2, id3, id4);
+
+  if (m && !b)
+    {
+      i = m->next;
+      m->next = (i + 1) % MEMO_SIZE;
+      if (m->count < MEMO_SIZE)
+	m->count++;
+      m->e[i].flags = flags;
+      m->e[i].cat = cat;
+      m->e[i].id1 = id1;
+      m->e[i].id2 = id2;
+      m->e[i].id3 = id3;
+      m->e[i].id4 = id4;
+      m->e[i].name = name;
+    }
+  return name;
+}
+
+static char *
+format_truncate(char *buf, int size, int res)
+{
   if (res >= size && size >= 4)
     buf[size-2] = buf[size-3] = buf[size-4] = '.';
   else if (res < 0 || res >= size)
@@ -86,49 +254,62 @@ format_name(char *buf, int size, int flags, char *name, char *num, char *unknown
   return buf;
 }
 
+/* Numbers are formatted only if they are really needed */
+static char *
+format_name(char *buf, int size, int flags, char *name, int num, int digits, char *unknown)
+{
+  char numbuf[16];
+  int res;
+
+  if ((flags & PCI_LOOKUP_NO_NUMBERS) && !name)
+    return NULL;
+  if (name && !(flags & (PCI_LOOKUP_NUMERIC | PCI_LOOKUP_MIXED)))
+    res = snprintf(buf, size, "%s", name);
+  else
+    {
+      sprintf(numbuf, "%0*x", digits, num);
+      if (flags & PCI_LOOKUP_NUMERIC)
+	res = snprintf(buf, size, "%s", numbuf);
+      else if (!name)
+	res = snprintf(buf, size, ((flags & PCI_LOOKUP_MIXED) ? "%s [%s]" : "%s %s"), unknown, numbuf);
+      else
+	res = snprintf(buf, size, "%s [%s]", name, numbuf);
+    }
+  return format_truncate(buf, size, res);
+}
+
 static char *
-format_name_pair(char *buf, int size, int flags, char *v, char *d, char *num)
+format_name_pair(char *buf, int size, int flags, char *v, char *d, int iv, int id)
 {
   int res;
   if ((flags & PCI_LOOKUP_NO_NUMBERS) && (!v || !d))
     return NULL;
   if (flags & PCI_LOOKUP_NUMERIC)
-    res = snprintf(buf, size, "%s", num);
+    res = snprintf(buf, size, "%04x:%04x", iv, id);
   else if (flags & PCI_LOOKUP_MIXED)
     {
       if (v && d)
-	res = snprintf(buf, size, "%s %s [%s]", v, d, num);
+	res = snprintf(buf, size, "%s %s [%04x:%04x]", v, d, iv, id);
       else if (!v)
-	res = snprintf(buf, size, "Device [%s]", num);
+	res = snprintf(buf, size, "Device [%04x:%04x]", iv, id);
       else /* v && !d */
-	res = snprintf(buf, size, "%s Device [%s]", v, num);
+	res = snprintf(buf, size, "%s Device [%04x:%04x]", v, iv, id);
     }
   else
     {
       if (v && d)
 	res = snprintf(buf, size, "%s %s", v, d);
       else if (!v)
-	res = snprintf(buf, size, "Device %s", num);
+	res = snprintf(buf, size, "Device %04x:%04x", iv, id);
       else /* v && !d */
-	res = snprintf(buf, size, "%s Device %s", v, num+5);
+	res = snprintf(buf, size, "%s Device %04x", v, id);
     }
-  if (res >= size && size >= 4)
-    buf[size-2] = buf[size-3] = buf[size-4] = '.';
-  else if (res < 0 || res >= size)
-    return "<pci_lookup_name: buffer too small>";
-  return buf;
+  return format_truncate(buf, size, res);
 }
 
-char *
-pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, ...)
+static int
+lookup_flags(struct pci_access *a, int flags)
 {
-  va_list args;
-  char *v, *d, *cls, *pif;
-  int iv, id, isv, isd, icls, ipif;
-  char numbuf[16], pifbuf[32];
-
-  va_start(args, flags);
-
   flags |= a->id_lookup_mode;
   if (!(flags & PCI_LOOKUP_NO_NUMBERS))
     {
@@ -140,70 +321,83 @@ pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, ...)
   if (flags & PCI_LOOKUP_MIXED)
     flags &= ~PCI_LOOKUP_NUMERIC;
 
-  if (!a->id_hash && !(flags & (PCI_LOOKUP_NUMERIC | PCI_LOOKUP_SKIP_LOCAL)) && !a->id_load_failed)
-    pci_load_name_list(a);
+#ifndef PCI_HAVE_EMBEDDED_IDS
+  /* With an embedded list, we load the file only when a name is missing there */
+  id_load_list(a, flags);
+#endif
+
+  return flags;
+}
+
+/*
+ *  The common part of pci_lookup_name() and pci_lookup_names_batch().
+ *  If direct is set and the result needs no formatting, we return
+ *  a pointer to the name in the database instead of copying it to buf.
+ */
+static char *
+lookup_name(struct pci_access *a, char *buf, int size, int flags, int *args, struct lookup_memo *m, int direct)
+{
+  char *v, *d, *cls, *pif;
+  int iv, id, isv, isd, icls, ipif;
+  char pifbuf[32];
+
+#define DIRECT(name) if (direct && (name) && !(flags & (PCI_LOOKUP_NUMERIC | PCI_LOOKUP_MIXED))) return (name)
 
   switch (flags & 0xffff)
     {
     case PCI_LOOKUP_VENDOR:
-      iv = va_arg(args, int);
-      sprintf(numbuf, "%04x", iv);
-      va_end(args);
-      return format_name(buf, size, flags, id_lookup(a, flags, ID_VENDOR, iv, 0, 0, 0), numbuf, "Vendor");
+      iv = args[0];
+      v = memo_lookup(a, m, flags, ID_VENDOR, iv, 0, 0, 0);
+      DIRECT(v);
+      return format_name(buf, size, flags, v, iv, 4, "Vendor");
     case PCI_LOOKUP_DEVICE:
-      iv = va_arg(args, int);
-      id = va_arg(args, int);
-      sprintf(numbuf, "%04x", id);
-      va_end(args);
-      return format_name(buf, size, flags, id_lookup(a, flags, ID_DEVICE, iv, id, 0, 0), numbuf, "Device");
+      iv = args[0];
+      id = args[1];
+      d = memo_lookup(a, m, flags, ID_DEVICE, iv, id, 0, 0);
+      DIRECT(d);
+      return format_name(buf, size, flags, d, id, 4, "Device");
     case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE:
-      iv = va_arg(args, int);
-      id = va_arg(args, int);
-      sprintf(numbuf, "%04x:%04x", iv, id);
-      v = id_lookup(a, flags, ID_VENDOR, iv, 0, 0, 0);
-      d = id_lookup(a, flags, ID_DEVICE, iv, id, 0, 0);
-      va_end(args);
-      return format_name_pair(buf, size, flags, v, d, numbuf);
+      iv = args[0];
+      id = args[1];
+      v = memo_lookup(a, m, flags, ID_VENDOR, iv, 0, 0, 0);
+      d = memo_lookup(a, m, flags, ID_DEVICE, iv, id, 0, 0);
+      return format_name_pair(buf, size, flags, v, d, iv, id);
     case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR:
-      isv = va_arg(args, int);
-      sprintf(numbuf, "%04x", isv);
-      v = id_lookup(a, flags, ID_VENDOR, isv, 0, 0, 0);
-      va_end(args);
-      return format_name(buf, size, flags, v, numbuf, "Unknown vendor");
+      isv = args[0];
+      v = memo_lookup(a, m, flags, ID_VENDOR, isv, 0, 0, 0);
+      DIRECT(v);
+      return format_name(buf, size, flags, v, isv, 4, "Unknown vendor");
     case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE:
-      iv = va_arg(args, int);
-      id = va_arg(args, int);
-      isv = va_arg(args, int);
-      isd = va_arg(args, int);
-      sprintf(numbuf, "%04x", isd);
-      va_end(args);
-      return format_name(buf, size, flags, id_lookup_subsys(a, flags, iv, id, isv, isd), numbuf, "Device");
+      iv = args[0];
+      id = args[1];
+      isv = args[2];
+      isd = args[3];
+      d = memo_lookup(a, m, flags, ID_SUBSYSTEM_ANY, iv, id, isv, isd);
+      DIRECT(d);
+      return format_name(buf, size, flags, d, isd, 4, "Device");
     case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_SUBSYSTEM:
-      iv = va_arg(args, int);
-      id = va_arg(args, int);
-      isv = va_arg(args, int);
-      isd = va_arg(args, int);
-      v = id_lookup(a, flags, ID_VENDOR, isv, 0, 0, 0);
-      d = id_lookup_subsys(a, flags, iv, id, isv, isd);
-      sprintf(numbuf, "%04x:%04x", isv, isd);
-      va_end(args);
-      return format_name_pair(buf, size, flags, v, d, numbuf);
+      iv = args[0];
+      id = args[1];
+      isv = args[2];
+      isd = args[3];
+      v = memo_lookup(a, m, flags, ID_VENDOR, isv, 0, 0, 0);
+      d = memo_lookup(a, m, flags, ID_SUBSYSTEM_ANY, iv, id, isv, isd);
+      return format_name_pair(buf, size, flags, v, d, isv, isd);
     case PCI_LOOKUP_CLASS:
-      icls = va_arg(args, int);
-      sprintf(numbuf, "%04x", icls);
-      cls = id_lookup(a, flags, ID_SUBCLASS, icls >> 8, icls & 0xff, 0, 0);
-      if (!cls && (cls = id_lookup(a, flags, ID_CLASS, icls >> 8, 0, 0, 0)))
+      icls = args[0];
+      cls = memo_lookup(a, m, flags, ID_SUBCLASS, icls >> 8, icls & 0xff, 0, 0);
+      if (!cls && !id_net_deferred(m ? m->batch : NULL) && (cls = memo_lookup(a, m, flags, ID_CLASS, icls >> 8, 0, 0, 0)))
 	{
 	  if (!(flags & PCI_LOOKUP_NUMERIC)) /* Include full class number */
 	    flags |= PCI_LOOKUP_MIXED;
 	}
-      va_end(args);
-      return format_name(buf, size, flags, cls, numbuf, "Class");
+      DIRECT(cls);
+      return format_name(buf, size, flags, cls, icls, 4, "Class");
     case PCI_LOOKUP_PROGIF:
-      icls = va_arg(args, int);
-      ipif = va_arg(args, int);
-      sprintf(numbuf, "%02x", ipif);
-      pif = id_lookup(a, flags, ID_PROGIF, icls >> 8, icls & 0xff, ipif, 0);
+      icls = args[0];
+      ipif = args[1];
+      pif = memo_lookup(a, m, flags, ID_PROGIF, icls >> 8, icls & 0xff, ipif, 0);
+      DIRECT(pif);
       if (!pif && icls == 0x0101 && !(ipif & 0x70))
 	{
 	  /* IDE controllers have complex prog-if semantics */
@@ -217,10 +411,309 @@ pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, ...)
 	  if (*pif)
 	    pif++;
 	}
-      va_end(args);
-      return format_name(buf, size, flags, pif, numbuf, "ProgIf");
+      return format_name(buf, size, flags, pif, ipif, 2, "ProgIf");
     default:
-      va_end(args);
       return "<pci_lookup_name: invalid request>";
     }
+
+#undef DIRECT
+}
+
+char *
+pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, ...)
+{
+  va_list args;
+  int iargs[4] = { 0, 0, 0, 0 };
+  int i, n;
+
+  flags = lookup_flags(a, flags);
+
+  switch (flags & 0xffff)
+    {
+    case PCI_LOOKUP_VENDOR:
+    case PCI_LOOKUP_CLASS:
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR:
+      n = 1;
+      break;
+    case PCI_LOOKUP_DEVICE:
+    case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE:
+    case PCI_LOOKUP_PROGIF:
+      n = 2;
+      break;
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE:
+    case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_SUBSYSTEM:
+      n = 4;
+      break;
+    default:
+      n = 0;
+    }
+
+  va_start(args, flags);
+  for (i=0; i<n; i++)
+    iargs[i] = va_arg(args, int);
+  va_end(args);
+
+  return lookup_name(a, buf, size, flags, iargs, NULL, 0);
+}
+
+/* Which of the candidates tried by id_lookup_subsys() gave the name */
+static enum id_entry_src
+id_subsys_source(struct pci_access *a, int iv, int id, int isv, int isd, char *name)
+{
+  enum id_entry_src src = SRC_UNKNOWN;
+
+  if (iv > 0 && id > 0)
+    src = pci_id_name_source(a, ID_SUBSYSTEM, iv, id, isv, isd, name);
+  if (src == SRC_UNKNOWN)
+    src = pci_id_name_source(a, ID_GEN_SUBSYSTEM, isv, isd, 0, 0, name);
+  if (src == SRC_UNKNOWN && iv == isv && id == isd)
+    src = pci_id_name_source(a, ID_DEVICE, iv, id, 0, 0, name);
+  return src;
+}
+
+const char *
+pci_lookup_raw_name(struct pci_access *a, enum pci_name_source *src, int flags, ...)
+{
+  va_list args;
+  int iargs[4] = { 0, 0, 0, 0 };
+  int i, n, cat, id1, id2, id3, id4;
+  enum id_entry_src s;
+  char *name;
+
+  if (src)
+    *src = PCI_NAME_UNKNOWN;
+  flags = lookup_flags(a, flags | PCI_LOOKUP_NO_NUMBERS);
+
+  switch (flags & 0xffff)
+    {
+    case PCI_LOOKUP_VENDOR:
+    case PCI_LOOKUP_CLASS:
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR:
+      n = 1;
+      break;
+    case PCI_LOOKUP_DEVICE:
+    case PCI_LOOKUP_PROGIF:
+      n = 2;
+      break;
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE:
+      n = 4;
+      break;
+    default:
+      return NULL;
+    }
+
+  va_start(args, flags);
+  for (i=0; i<n; i++)
+    iargs[i] = va_arg(args, int);
+  va_end(args);
+
+  id1 = iargs[0];
+  id2 = iargs[1];
+  id3 = id4 = 0;
+  switch (flags & 0xffff)
+    {
+    case PCI_LOOKUP_VENDOR:
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR:
+      cat = ID_VENDOR;
+      break;
+    case PCI_LOOKUP_DEVICE:
+      cat = ID_DEVICE;
+      break;
+    case PCI_LOOKUP_CLASS:
+      cat = ID_SUBCLASS;
+      id1 = iargs[0] >> 8;
+      id2 = iargs[0] & 0xff;
+      break;
+    case PCI_LOOKUP_PROGIF:
+      cat = ID_PROGIF;
+      id1 = iargs[0] >> 8;
+      id2 = iargs[0] & 0xff;
+      id3 = iargs[1];
+      break;
+    default:
+      if (!(name = id_lookup_subsys(a, NULL, flags, iargs[0], iargs[1], iargs[2], iargs[3])))
+	return NULL;
+      s = src ? id_subsys_source(a, iargs[0], iargs[1], iargs[2], iargs[3], name) : SRC_UNKNOWN;
+      goto found;
+    }
+
+  if (!(name = id_lookup(a, NULL, flags, cat, id1, id2, id3, id4)))
+    return NULL;
+  s = src ? pci_id_name_source(a, cat, id1, id2, id3, id4, name) : SRC_UNKNOWN;
+
+found:
+  if (src)
+    switch (s)
+      {
+      case SRC_LOCAL:
+	*src = PCI_NAME_LOCAL;
+	break;
+      case SRC_HWDB:
+	*src = PCI_NAME_HWDB;
+	break;
+      case SRC_NET:
+	*src = PCI_NAME_NET;
+	break;
+      case SRC_CACHE:
+	*src = PCI_NAME_CACHE;
+	break;
+      default:
+	break;
+      }
+  return name;
+}
+
+/*
+ *  Before the requests are processed, we ask the HWDB about all ID's missing
+ *  in the local list in as few queries as possible (see pci_id_hwdb_preload()).
+ */
+static int
+id_hwdb_wanted(struct pci_access *a, int flags, int cat, int id1, int id2, int id3, int id4)
+{
+  enum id_entry_src src;
+
+  if (a->id_db->lazy)
+    pci_id_lazy_load(a, cat, id1);
+  if (pci_id_lookup(a, flags, cat, id1, id2, id3, id4))
+    return 0;
+  src = pci_id_source(a, cat, id1, id2, id3, id4);
+  return (src != SRC_HWDB && src != SRC_HWDB_MISS);
+}
+
+/* Called with the database locked; returns 0 if the HWDB is not available */
+static int
+id_hwdb_preload_one(struct pci_access *a, int flags, int *x)
+{
+  switch (flags & 0xffff)
+    {
+    case PCI_LOOKUP_VENDOR:
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR:
+      if (id_hwdb_wanted(a, flags, ID_VENDOR, x[0], 0, 0, 0))
+	return pci_id_hwdb_preload(a, ID_VENDOR, x[0], 0, 0, 0);
+      break;
+    case PCI_LOOKUP_DEVICE:
+    case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE:
+      if (id_hwdb_wanted(a, flags, ID_VENDOR, x[0], 0, 0, 0) ||
+	  id_hwdb_wanted(a, flags, ID_DEVICE, x[0], x[1], 0, 0))
+	return pci_id_hwdb_preload(a, ID_DEVICE, x[0], x[1], 0, 0);
+      break;
+    case PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE:
+    case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_SUBSYSTEM:
+      if (id_hwdb_wanted(a, flags, ID_VENDOR, x[2], 0, 0, 0) ||
+	  (x[0] > 0 && x[1] > 0 && id_hwdb_wanted(a, flags, ID_SUBSYSTEM, x[0], x[1], x[2], x[3])))
+	return pci_id_hwdb_preload(a, ID_SUBSYSTEM, x[0], x[1], x[2], x[3]);
+      break;
+    case PCI_LOOKUP_CLASS:
+      if (id_hwdb_wanted(a, flags, ID_CLASS, x[0] >> 8, 0, 0, 0) ||
+	  id_hwdb_wanted(a, flags, ID_SUBCLASS, x[0] >> 8, x[0] & 0xff, 0, 0))
+	return pci_id_hwdb_preload(a, ID_SUBCLASS, x[0] >> 8, x[0] & 0xff, 0, 0);
+      break;
+    case PCI_LOOKUP_PROGIF:
+      if (id_hwdb_wanted(a, flags, ID_CLASS, x[0] >> 8, 0, 0, 0) ||
+	  id_hwdb_wanted(a, flags, ID_SUBCLASS, x[0] >> 8, x[0] & 0xff, 0, 0) ||
+	  id_hwdb_wanted(a, flags, ID_PROGIF, x[0] >> 8, x[0] & 0xff, x[1], 0))
+	return pci_id_hwdb_preload(a, ID_PROGIF, x[0] >> 8, x[0] & 0xff, x[1], 0);
+      break;
+    }
+  return 1;
+}
+
+static void
+id_hwdb_preload(struct pci_access *a, struct pci_lookup_request *reqs, int n)
+{
+  char *param = pci_get_param(a, "hwdb.preload");
+  int i, flags, ok;
+
+  if (!param || !atoi(param))
+    return;
+  for (i=0; i<n; i++)
+    {
+      flags = lookup_flags(a, reqs[i].flags);
+      if (flags & (PCI_LOOKUP_NUMERIC | PCI_LOOKUP_SKIP_LOCAL | PCI_LOOKUP_NO_HWDB))
+	continue;
+      pci_id_lock(a);
+      ok = id_hwdb_preload_one(a, flags, reqs[i].args);
+      pci_id_unlock(a);
+      if (!ok)
+	return;
+    }
+}
+
+/*
+ *  Instead of asking the DNS for each unknown ID separately, we first make
+ *  a dry run of all requests, during which id_lookup() only records the
+ *  ID's it would send to the network. Then we resolve all of them at once
+ *  and repeat, since the result can lead to another query (e.g., when the
+ *  subsystem lookup falls back to the generic subsystem).
+ */
+static void
+id_net_prefetch(struct pci_access *a, struct pci_lookup_request *reqs, int n)
+{
+  struct id_net_batch batch;
+  struct id_net_query *q;
+  struct lookup_memo memo;
+  char buf[256];
+  int i, flags;
+
+  memset(&batch, 0, sizeof(batch));
+  memo.count = memo.next = 0;
+  memo.batch = &batch;
+  for (;;)
+    {
+      batch.count = 0;
+      for (i=0; i<n; i++)
+	{
+	  flags = lookup_flags(a, reqs[i].flags);
+	  if (flags & PCI_LOOKUP_NETWORK)
+	    lookup_name(a, buf, sizeof(buf), flags, reqs[i].args, &memo, 1);
+	}
+      if (!batch.count)
+	break;
+
+      pci_id_net_lookup_many(a, batch.queries, batch.count);
+      pci_id_lock(a);
+      for (i=0; i<batch.count; i++)
+	{
+	  q = &batch.queries[i];
+	  id_net_insert(a, q->cat, q->id1, q->id2, q->id3, q->id4, q->name, q->ttl);
+	}
+      pci_id_unlock(a);
+    }
+  pci_mfree(batch.queries);
+}
+
+void
+pci_lookup_names_batch(struct pci_access *a, struct pci_lookup_request *reqs, int n)
+{
+  struct lookup_memo memo;
+  int i;
+
+  id_hwdb_preload(a, reqs, n);
+  for (i=0; i<n; i++)
+    if ((reqs[i].flags | a->id_lookup_mode) & PCI_LOOKUP_NETWORK)
+      {
+	id_net_prefetch(a, reqs, n);
+	break;
+      }
+
+  memo.count = memo.next = 0;
+  memo.batch = NULL;
+  for (i=0; i<n; i++)
+    {
+      struct pci_lookup_request *r = &reqs[i];
+      int flags = lookup_flags(a, r->flags);
+      r->result = lookup_name(a, r->buf, r->size, flags, r->args, &memo, 1);
+    }
+}
+
+int
+pci_search_names(struct pci_access *a, int flags, char *pattern, struct pci_id_match *m, int max)
+{
+  int n;
+
+  id_load_list(a, lookup_flags(a, PCI_LOOKUP_NO_NUMBERS));
+  pci_id_lock(a);
+  n = pci_id_search(a, flags, pattern, m, max);
+  pci_id_unlock(a);
+  return n;
 }
@@ -8,14 +8,52 @@
 
 #define MAX_LINE 1024
 
+#ifdef PCI_HAVE_PTHREAD
+#include <pthread.h>
+/* Fields read by lock-free readers are accessed atomically, which costs nothing */
+#define ID_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define ID_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+#define ID_LOAD(x) (x)
+#define ID_STORE(x, v) ((x) = (v))
+#endif
+
+/*
+ *  The name database. It can be shared by multiple pci_access structures
+ *  (see pci_share_name_list()), so it must not point back to any of them.
+ */
+
+struct id_db {
+  int refcnt;
+  struct id_entry *hash;		/* names-hash.c */
+  unsigned int hash_size, hash_count;
+  struct id_strings *strings;
+  struct id_classes *classes;		/* Dense tables of class entries */
+  struct id_bucket *current_bucket;
+  int load_failed;
+  int cache_status;			/* names-cache.c: 0=not read, 1=read, 2=dirty */
+  int cache_rewrite;			/* Cache file has to be rewritten instead of appended to */
+  struct udev *udev;			/* names-hwdb.c */
+  struct udev_hwdb *udev_hwdb;
+  struct id_index *index;		/* names-index.c */
+  struct id_lazy *lazy;			/* names-parse.c */
+  struct id_search *search;		/* names-search.c */
+  int loaded;				/* names.c: loading attempted, lock-free lookups allowed */
+#ifdef PCI_HAVE_PTHREAD
+  pthread_mutex_t lock;			/* names-hash.c: serializes all modifications */
+  unsigned int seq;			/* Odd while the hash is being modified */
+  struct id_old_hash *old_hash;		/* Hash tables replaced while lock-free readers could use them */
+#endif
+};
+
 /* names-hash.c */
 
 struct id_entry {
-  struct id_entry *next;
   u32 id12, id34;
+  u32 expires;				/* SRC_CACHE, SRC_NET: expiry time or 0 if not known */
   byte cat;
   byte src;
-  char name[1];
+  char *name;
 };
 
 enum id_entry_type {
@@ -29,16 +67,27 @@ enum id_entry_type {
   ID_PROGIF
 };
 
-enum id_entry_src {
+enum id_entry_src {			/* In the order of increasing precedence */
   SRC_UNKNOWN,
+  SRC_HWDB_MISS,			/* Negative entry: not found in the HWDB */
   SRC_CACHE,
   SRC_NET,
   SRC_HWDB,
   SRC_LOCAL,
 };
 
+struct id_class_table {			/* Subclasses and prog-if's of a single class */
+  struct id_entry subclasses[256];
+  struct id_entry *progifs[256];	/* For each subclass, allocated when needed */
+};
+
+struct id_classes {
+  struct id_entry classes[256];
+  struct id_class_table *tables[256];
+};
+
 #define BUCKET_SIZE 8192
-#define HASH_SIZE 4099
+#define HASH_INITIAL_SIZE 1024
 
 static inline u32 id_pair(unsigned int x, unsigned int y)
 {
@@ -56,7 +105,26 @@ static inline unsigned int pair_second(unsigned int x)
 }
 
 int pci_id_insert(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src);
+int pci_id_insert_expiring(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src, u32 expires);
+int pci_id_insert_static(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text, enum id_entry_src src);
 char *pci_id_lookup(struct pci_access *a, int flags, int cat, int id1, int id2, int id3, int id4);
+struct id_entry *pci_id_walk(struct pci_access *a, unsigned int *pos);
+enum id_entry_src pci_id_source(struct pci_access *a, int cat, int id1, int id2, int id3, int id4);
+enum id_entry_src pci_id_name_source(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *name);
+void pci_id_strings_drop(struct pci_access *a);
+void pci_id_strings_stats(struct pci_access *a);
+void pci_id_db_lock_init(struct id_db *db);
+void pci_id_db_lock_cleanup(struct id_db *db);
+void pci_id_lock(struct pci_access *a);
+void pci_id_unlock(struct pci_access *a);
+int pci_id_loaded(struct pci_access *a);
+void pci_id_set_loaded(struct pci_access *a, int loaded);
+
+/* names-parse.c */
+
+void pci_id_lazy_load(struct pci_access *a, int cat, int id1);
+void pci_id_lazy_load_all(struct pci_access *a);
+int pci_id_lazy_loaded(struct pci_access *a, int cat, int id1);
 
 /* names-cache.c */
 
@@ -65,11 +133,68 @@ void pci_id_cache_dirty(struct pci_access *a);
 void pci_id_cache_flush(struct pci_access *a);
 void pci_id_hash_free(struct pci_access *a);
 
-/* names-dns.c */
+/* names-index.c */
+
+#define ID_INDEX_MAGIC 0x78646970	/* "pidx" in little endian */
+#define ID_INDEX_VERSION 1
+
+struct id_index_header {
+  u32 magic;
+  u32 version;
+  u64 src_size;				/* Size of the ID file the index was built from */
+  u64 src_mtime;			/* ... and its modification time */
+  u32 num_entries;
+  u32 entries_offset;			/* Array of struct id_index_entry sorted by (cat, id12, id34) */
+  u32 strings_offset;			/* Pool of NUL-terminated names */
+  u32 strings_size;
+};
+
+struct id_index_entry {
+  u32 id12, id34;
+  u32 cat;
+  u32 name;				/* Offset in the string pool */
+};
+
+char *pci_id_index_name(struct pci_access *a, char *buf, int size);
+int pci_id_index_load(struct pci_access *a);
+char *pci_id_index_lookup(struct pci_access *a, int cat, u32 id12, u32 id34);
+void pci_id_index_free(struct pci_access *a);
+struct id_index_entry *pci_id_index_entries(struct pci_access *a, u32 *num, char **strings, u32 *strings_size);
+int pci_id_index_write(struct pci_access *a, char *name);
+int pci_id_shm_attach(struct pci_access *a);
+void pci_id_shm_publish(struct pci_access *a);
+
+/* names-net.c */
+
+struct id_net_query {
+  int cat, id1, id2, id3, id4;
+  char *name;				/* Result: allocated name or NULL if not found */
+  unsigned int ttl;			/* How long the result is valid (0 if not known) */
+};
+
+char *pci_id_net_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, unsigned int *ttl);
+void pci_id_net_lookup_many(struct pci_access *a, struct id_net_query *q, int n);
+
+/* names.c */
+
+struct id_net_batch {			/* Network queries postponed by pci_lookup_names_batch() */
+  struct id_net_query *queries;
+  int count, max;
+  int deferred;				/* The last id_lookup() has been postponed */
+};
+
+/* names-embedded.c */
+
+char *pci_id_embedded_lookup(int cat, int id1, int id2, int id3, int id4);
+const struct id_index_entry *pci_id_embedded_entries(u32 *num, const char **names);
+
+/* names-search.c */
 
-char *pci_id_net_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4);
+int pci_id_search(struct pci_access *a, int flags, char *pattern, struct pci_id_match *m, int max);
+void pci_id_search_free(struct pci_access *a);
 
 /* names-hwdb.c */
 
 char *pci_id_hwdb_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4);
+int pci_id_hwdb_preload(struct pci_access *a, int cat, int id1, int id2, int id3, int id4);
 void pci_id_hwdb_free(struct pci_access *a);
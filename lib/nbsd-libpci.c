@@ -153,5 +153,6 @@ struct pci_methods pm_nbsd_libpci = {
   nbsd_write,
   NULL,                                 /* read_vpd */
   NULL,                                 /* dev_init */
-  NULL                                  /* dev_cleanup */
+  NULL,                                 /* dev_cleanup */
+  NULL                                  /* read_batch */
 };
@@ -148,5 +148,6 @@ struct pci_methods pm_obsd_device = {
   obsd_write,
   NULL,                                 /* read_vpd */
   NULL,                                 /* dev_init */
-  NULL                                  /* dev_cleanup */
+  NULL,                                 /* dev_cleanup */
+  NULL                                  /* read_batch */
 };
@@ -70,17 +70,11 @@ struct pci_access {
   /* Fields used internally: */
   struct pci_methods *methods;
   struct pci_param *params;
-  struct id_entry **id_hash;		/* names.c */
-  struct id_bucket *current_id_bucket;
-  int id_load_failed;
-  int id_cache_status;			/* 0=not read, 1=read, 2=dirty */
-  struct udev *id_udev;			/* names-hwdb.c */
-  struct udev_hwdb *id_udev_hwdb;
-  int fd;				/* proc/sys: fd for config space */
-  int fd_rw;				/* proc/sys: fd opened read-write */
+  struct id_db *id_db;			/* names-parse.c: name database, possibly shared */
+  int fd;				/* proc/sys: fd the fd_pos refers to */
+  int fd_rw;				/* fd opened read-write */
   int fd_pos;				/* proc/sys: current position */
-  int fd_vpd;				/* sys: fd for VPD */
-  struct pci_dev *cached_dev;		/* proc/sys: device the fds are for */
+  struct pci_fd_pool *fd_pool;		/* proc/sys: open files of devices */
 };
 
 /* Initialize PCI access */
@@ -141,6 +135,7 @@ struct pci_dev {
   pciaddr_t flags[6];			/* PCI_IORESOURCE_* flags for regions */
   pciaddr_t rom_flags;			/* PCI_IORESOURCE_* flags for expansion ROM */
   int domain;				/* PCI domain (host bridge) */
+  u16 subsys_vendor_id, subsys_id;	/* Subsystem identity (0xffff if not available) */
 
   /* Fields used internally */
   struct pci_access *access;
@@ -151,6 +146,7 @@ struct pci_dev {
   void *aux;				/* Auxiliary data */
   struct pci_property *properties;	/* A linked list of extra properties */
   struct pci_cap *last_cap;		/* Last capability in the list */
+  struct pci_fd *fds;			/* proc/sys: open files of this device */
 };
 
 #define PCI_ADDR_IO_MASK (~(pciaddr_t) 0x3)
@@ -167,6 +163,23 @@ int pci_write_word(struct pci_dev *, int pos, u16 data) PCI_ABI;
 int pci_write_long(struct pci_dev *, int pos, u32 data) PCI_ABI;
 int pci_write_block(struct pci_dev *, int pos, u8 *buf, int len) PCI_ABI;
 
+/*
+ *	Reading config space of many devices at once: each request is
+ *	processed like a call to pci_read_block(), but the access method
+ *	can issue all of them together (linux-sysfs does so via io_uring).
+ *	Returns the number of successful requests.
+ */
+
+struct pci_read_request {
+  struct pci_dev *dev;
+  int pos;
+  u8 *buf;
+  int len;
+  int result;				/* Filled in by pci_read_blocks(): 1 if OK, 0 if not */
+};
+
+int pci_read_blocks(struct pci_access *a, struct pci_read_request *reqs, int n) PCI_ABI;
+
 /*
  * Most device properties take some effort to obtain, so libpci does not
  * initialize them during default bus scan. Instead, you have to call
@@ -193,6 +206,7 @@ char *pci_get_string_property(struct pci_dev *d, u32 prop) PCI_ABI;
 #define PCI_FILL_NUMA_NODE	0x0800
 #define PCI_FILL_IO_FLAGS	0x1000
 #define PCI_FILL_DT_NODE	0x2000		/* Device tree node */
+#define PCI_FILL_SUBSYS		0x4000
 #define PCI_FILL_RESCAN		0x00010000
 
 void pci_setup_cache(struct pci_dev *, u8 *cache, int len) PCI_ABI;
@@ -248,9 +262,67 @@ int pci_filter_match(struct pci_filter *, struct pci_dev *) PCI_ABI;
 
 char *pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, ...) PCI_ABI;
 
+/*
+ *	Looking up many names at once: each request carries the same flags
+ *	and arguments as a call to pci_lookup_name(), with unused arguments
+ *	ignored. The result either points to buf or, if the name needs no
+ *	formatting, directly to the name database, in which case it stays
+ *	valid until the database is freed.
+ */
+
+struct pci_lookup_request {
+  int flags;				/* PCI_LOOKUP_xxx */
+  int args[4];				/* ID's as passed to pci_lookup_name() */
+  char *buf;				/* Buffer for the formatted name */
+  int size;
+  char *result;				/* Filled in by pci_lookup_names_batch() */
+};
+
+void pci_lookup_names_batch(struct pci_access *a, struct pci_lookup_request *reqs, int n) PCI_ABI;
+
+/*
+ *	Looking up names without copying: takes the flags and arguments of
+ *	pci_lookup_name() for a single name (VENDOR, DEVICE, CLASS, PROGIF,
+ *	SUBSYSTEM | VENDOR or SUBSYSTEM | DEVICE) and returns the name as stored
+ *	in the database, or NULL if it is not known. CLASS gives the name of the
+ *	subclass only. The name stays valid until the database is freed. If src
+ *	is not NULL, it is set to where the name comes from.
+ */
+
+enum pci_name_source {
+  PCI_NAME_UNKNOWN,			/* Name not found */
+  PCI_NAME_LOCAL,			/* Local ID list (including the one linked into the library) */
+  PCI_NAME_HWDB,			/* udev's hwdb */
+  PCI_NAME_NET,				/* Resolved by DNS */
+  PCI_NAME_CACHE,			/* Local cache of DNS results */
+};
+
+const char *pci_lookup_raw_name(struct pci_access *a, enum pci_name_source *src, int flags, ...) PCI_ABI;
+
+/*
+ *	Searching for ID's by name: finds all entries of the ID list whose
+ *	names contain the pattern, ignoring case. Flags select the kinds of
+ *	names to search (PCI_LOOKUP_VENDOR, DEVICE, CLASS and PROGIF; none
+ *	means all of them). Fills in at most max matches, sorted by kind and
+ *	ID, and returns the number of all matches. The names stay valid until
+ *	the database is freed.
+ */
+
+struct pci_id_match {
+  int flags;				/* Kind of the name: one of PCI_LOOKUP_{VENDOR,DEVICE,CLASS,PROGIF} */
+  int vendor, device;			/* -1 if not applicable */
+  int device_class, class_mask;		/* Matching classes have (class & class_mask) == device_class */
+  int prog_if;				/* -1 if not applicable */
+  char *name;
+};
+
+int pci_search_names(struct pci_access *a, int flags, char *pattern, struct pci_id_match *m, int max) PCI_ABI;
+
 int pci_load_name_list(struct pci_access *a) PCI_ABI;	/* Called automatically by pci_lookup_*() when needed; returns success */
 void pci_free_name_list(struct pci_access *a) PCI_ABI;	/* Called automatically by pci_cleanup() */
 void pci_set_name_list_path(struct pci_access *a, char *name, int to_be_freed) PCI_ABI;
+void pci_share_name_list(struct pci_access *a, struct pci_access *from) PCI_ABI;	/* Use the same name database as another access */
+int pci_compile_name_list(struct pci_access *a, char *index_name) PCI_ABI;	/* Parse the ID list and write its binary index; NULL = default name */
 void pci_id_cache_flush(struct pci_access *a) PCI_ABI;
 
 enum pci_lookup_mode {
@@ -31,14 +31,16 @@ static int pwrite(unsigned int fd, void *buf, size_t size, loff_t where)
 { return syscall(SYS_pwrite, fd, buf, size, where); }
 
 #else
-/* In all other cases we use lseek/read/write instead to be safe */
+/* In all other cases we use lseek/read/write instead to be safe,
+   a->fd_pos is the position of a->fd */
 #define make_rw_glue(op) \
 	static int do_##op(struct pci_dev *d, int fd, void *buf, size_t size, int where)	\
 	{											\
 	  struct pci_access *a = d->access;							\
 	  int r;										\
-	  if (a->fd_pos != where && lseek(fd, where, SEEK_SET) < 0)				\
+	  if ((a->fd != fd || a->fd_pos != where) && lseek(fd, where, SEEK_SET) < 0)		\
 	    return -1;										\
+	  a->fd = fd;										\
 	  r = op(fd, buf, size);								\
 	  if (r < 0)										\
 	    a->fd_pos = -1;									\
@@ -9,6 +9,7 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -22,6 +23,7 @@ static void
 proc_config(struct pci_access *a)
 {
   pci_define_param(a, "proc.path", PCI_PATH_PROC_BUS_PCI, "Path to the procfs bus tree");
+  pci_define_param(a, "proc.fds", "16", "Maximum number of config files kept open");
 }
 
 static int
@@ -41,17 +43,13 @@ proc_detect(struct pci_access *a)
 static void
 proc_init(struct pci_access *a)
 {
-  a->fd = -1;
+  pci_fd_pool_init(a, atoi(pci_get_param(a, "proc.fds")));
 }
 
 static void
 proc_cleanup(struct pci_access *a)
 {
-  if (a->fd >= 0)
-    {
-      close(a->fd);
-      a->fd = -1;
-    }
+  pci_fd_pool_cleanup(a);
 }
 
 static void
@@ -113,38 +111,36 @@ proc_scan(struct pci_access *a)
 }
 
 static int
-proc_setup(struct pci_dev *d, int rw)
+proc_open_fd(struct pci_dev *d, int kind UNUSED, int rw)
 {
   struct pci_access *a = d->access;
+  char buf[1024];
+  int e, fd;
 
-  if (a->cached_dev != d || a->fd_rw < rw)
+  e = snprintf(buf, sizeof(buf), "%s/%02x/%02x.%d",
+	       pci_get_param(a, "proc.path"),
+	       d->bus, d->dev, d->func);
+  if (e < 0 || e >= (int) sizeof(buf))
+    a->error("File name too long");
+  fd = open(buf, rw ? O_RDWR : O_RDONLY);
+  if (fd < 0)
     {
-      char buf[1024];
-      int e;
-      if (a->fd >= 0)
-	close(a->fd);
-      e = snprintf(buf, sizeof(buf), "%s/%02x/%02x.%d",
+      e = snprintf(buf, sizeof(buf), "%s/%04x:%02x/%02x.%d",
 		   pci_get_param(a, "proc.path"),
-		   d->bus, d->dev, d->func);
+		   d->domain, d->bus, d->dev, d->func);
       if (e < 0 || e >= (int) sizeof(buf))
 	a->error("File name too long");
-      a->fd_rw = a->writeable || rw;
-      a->fd = open(buf, a->fd_rw ? O_RDWR : O_RDONLY);
-      if (a->fd < 0)
-	{
-	  e = snprintf(buf, sizeof(buf), "%s/%04x:%02x/%02x.%d",
-		       pci_get_param(a, "proc.path"),
-		       d->domain, d->bus, d->dev, d->func);
-	  if (e < 0 || e >= (int) sizeof(buf))
-	    a->error("File name too long");
-	  a->fd = open(buf, a->fd_rw ? O_RDWR : O_RDONLY);
-	}
-      if (a->fd < 0)
-	a->warning("Cannot open %s", buf);
-      a->cached_dev = d;
-      a->fd_pos = 0;
+      fd = open(buf, rw ? O_RDWR : O_RDONLY);
     }
-  return a->fd;
+  if (fd < 0)
+    a->warning("Cannot open %s", buf);
+  return fd;
+}
+
+static int
+proc_setup(struct pci_dev *d, int rw)
+{
+  return pci_fd_get(d, PCI_FD_CONFIG, d->access->writeable || rw, proc_open_fd);
 }
 
 static int
@@ -191,8 +187,7 @@ proc_write(struct pci_dev *d, int pos, byte *buf, int len)
 static void
 proc_cleanup_dev(struct pci_dev *d)
 {
-  if (d->access->cached_dev == d)
-    d->access->cached_dev = NULL;
+  pci_fd_close_dev(d);
 }
 
 struct pci_methods pm_linux_proc = {
@@ -208,5 +203,6 @@ struct pci_methods pm_linux_proc = {
   proc_write,
   NULL,					/* read_vpd */
   NULL,					/* init_dev */
-  proc_cleanup_dev
+  proc_cleanup_dev,
+  NULL					/* read_batch */
 };
@@ -155,4 +155,5 @@ struct pci_methods pm_sylixos_device = {
   NULL,			// no read_vpd
   NULL,			// no init_dev
   NULL,			// no cleanup_dev
+  NULL,			// no read_batch
 };
@@ -22,10 +22,16 @@
 #include "internal.h"
 #include "pread.h"
 
+#ifdef PCI_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 static void
 sysfs_config(struct pci_access *a)
 {
   pci_define_param(a, "sysfs.path", PCI_PATH_SYS_BUS_PCI, "Path to the sysfs device tree");
+  pci_define_param(a, "sysfs.fds", "16", "Maximum number of device directories, config and VPD files kept open");
+  pci_define_param(a, "sysfs.threads", "0", "Number of threads reading identity of devices during the scan (0=read on demand)");
 }
 
 static inline char *
@@ -49,40 +55,67 @@ sysfs_detect(struct pci_access *a)
 static void
 sysfs_init(struct pci_access *a)
 {
-  a->fd = -1;
-  a->fd_vpd = -1;
-}
-
-static void
-sysfs_flush_cache(struct pci_access *a)
-{
-  if (a->fd >= 0)
-    {
-      close(a->fd);
-      a->fd = -1;
-    }
-  if (a->fd_vpd >= 0)
-    {
-      close(a->fd_vpd);
-      a->fd_vpd = -1;
-    }
-  a->cached_dev = NULL;
+  pci_fd_pool_init(a, atoi(pci_get_param(a, "sysfs.fds")));
 }
 
 static void
 sysfs_cleanup(struct pci_access *a)
 {
-  sysfs_flush_cache(a);
+  pci_fd_pool_cleanup(a);
 }
 
+/*
+ *  Attributes are opened relative to an O_PATH descriptor of the device
+ *  directory, so that the kernel need not walk the whole path again.
+ *  The descriptors live in the pool of open files together with the config
+ *  and VPD files, so recently used devices keep theirs. Worker threads
+ *  of the scan must not touch the pool, so they use full paths. Neither
+ *  can they report errors, so they only mark the device as failed.
+ */
+
+struct sysfs_dev {
+  int in_worker;			/* Being read by a worker thread of the scan */
+  int failed;				/* The worker has hit an error */
+};
+
 #define OBJNAMELEN 1024
 static void
 sysfs_obj_name(struct pci_dev *d, char *object, char *buf)
 {
+  struct sysfs_dev *sd = d->aux;
   int n = snprintf(buf, OBJNAMELEN, "%s/devices/%04x:%02x:%02x.%d/%s",
 		   sysfs_name(d->access), d->domain, d->bus, d->dev, d->func, object);
   if (n < 0 || n >= OBJNAMELEN)
-    d->access->error("File name too long");
+    {
+      if (!sd->in_worker)
+	d->access->error("File name too long");
+      sd->failed = 1;
+      buf[0] = 0;
+    }
+}
+
+static int sysfs_open_fd(struct pci_dev *d, int kind, int rw);
+
+static int
+sysfs_dir_fd(struct pci_dev *d)
+{
+  struct sysfs_dev *sd = d->aux;
+
+  if (sd->in_worker)
+    return -1;
+  return pci_fd_get(d, PCI_FD_DIR, 0, sysfs_open_fd);
+}
+
+static int
+sysfs_open(struct pci_dev *d, char *object, int flags)
+{
+  int dir_fd = sysfs_dir_fd(d);
+  char namebuf[OBJNAMELEN];
+
+  if (dir_fd >= 0)
+    return openat(dir_fd, object, flags);
+  sysfs_obj_name(d, object, namebuf);
+  return open(namebuf, flags);
 }
 
 #define OBJBUFSIZE 1024
@@ -91,32 +124,50 @@ static int
 sysfs_get_string(struct pci_dev *d, char *object, char *buf, int mandatory)
 {
   struct pci_access *a = d->access;
+  struct sysfs_dev *sd = d->aux;
   int fd, n;
   char namebuf[OBJNAMELEN];
   void (*warn)(char *msg, ...) = (mandatory ? a->error : a->warning);
 
-  sysfs_obj_name(d, object, namebuf);
-  fd = open(namebuf, O_RDONLY);
+  fd = sysfs_open(d, object, O_RDONLY);
   if (fd < 0)
     {
       if (mandatory || errno != ENOENT)
-	warn("Cannot open %s: %s", namebuf, strerror(errno));
+	{
+	  int err = errno;
+	  if (sd->in_worker)
+	    goto failed;
+	  sysfs_obj_name(d, object, namebuf);
+	  warn("Cannot open %s: %s", namebuf, strerror(err));
+	}
       return 0;
     }
   n = read(fd, buf, OBJBUFSIZE);
-  close(fd);
   if (n < 0)
     {
-      warn("Error reading %s: %s", namebuf, strerror(errno));
+      int err = errno;
+      close(fd);
+      if (sd->in_worker)
+	goto failed;
+      sysfs_obj_name(d, object, namebuf);
+      warn("Error reading %s: %s", namebuf, strerror(err));
       return 0;
      }
+  close(fd);
   if (n >= OBJBUFSIZE)
     {
+      if (sd->in_worker)
+	goto failed;
+      sysfs_obj_name(d, object, namebuf);
       warn("Value in %s too long", namebuf);
       return 0;
     }
   buf[n] = 0;
   return 1;
+
+failed:
+  sd->failed = 1;
+  return 0;
 }
 
 static char *
@@ -124,11 +175,20 @@ sysfs_deref_link(struct pci_dev *d, char *link_name)
 {
   char path[2*OBJNAMELEN], rel_path[OBJNAMELEN];
 
-  sysfs_obj_name(d, link_name, path);
-  memset(rel_path, 0, sizeof(rel_path));
+  int dir_fd = sysfs_dir_fd(d);
 
-  if (readlink(path, rel_path, sizeof(rel_path)) < 0)
-    return NULL;
+  memset(rel_path, 0, sizeof(rel_path));
+  if (dir_fd >= 0)
+    {
+      if (readlinkat(dir_fd, link_name, rel_path, sizeof(rel_path)) < 0)
+	return NULL;
+    }
+  else
+    {
+      sysfs_obj_name(d, link_name, path);
+      if (readlink(path, rel_path, sizeof(rel_path)) < 0)
+	return NULL;
+    }
 
   sysfs_obj_name(d, "", path);
   strcat(path, rel_path);
@@ -154,19 +214,25 @@ sysfs_get_resources(struct pci_dev *d)
   struct pci_access *a = d->access;
   char namebuf[OBJNAMELEN], buf[256];
   FILE *file;
-  int i;
+  int fd, i;
 
-  sysfs_obj_name(d, "resource", namebuf);
-  file = fopen(namebuf, "r");
-  if (!file)
-    a->error("Cannot open %s: %s", namebuf, strerror(errno));
+  fd = sysfs_open(d, "resource", O_RDONLY);
+  if (fd < 0 || !(file = fdopen(fd, "r")))
+    {
+      int err = errno;
+      sysfs_obj_name(d, "resource", namebuf);
+      a->error("Cannot open %s: %s", namebuf, strerror(err));
+    }
   for (i = 0; i < 7; i++)
     {
       unsigned long long start, end, size, flags;
       if (!fgets(buf, sizeof(buf), file))
 	break;
       if (sscanf(buf, "%llx %llx %llx", &start, &end, &flags) != 3)
-	a->error("Syntax error in %s", namebuf);
+	{
+	  sysfs_obj_name(d, "resource", namebuf);
+	  a->error("Syntax error in %s", namebuf);
+	}
       if (end > start)
 	size = end - start + 1;
       else
@@ -189,12 +255,151 @@ sysfs_get_resources(struct pci_dev *d)
   fclose(file);
 }
 
+/*
+ *  The uevent file gives the identity, class, subsystem and module alias
+ *  of the device in a single read. We could read the ID's faster from the
+ *  config registers, but we want to give the kernel a chance to fix up ID's
+ *  and especially classes of broken devices. Old kernels do not have all the
+ *  variables, so we fall back to the separate attribute files.
+ */
+static int
+sysfs_get_ident(struct pci_dev *d)
+{
+  struct sysfs_dev *sd = d->aux;
+  char buf[OBJBUFSIZE], *line, *next, *val;
+  unsigned int x, y;
+  int known = 0;
+
+  if (sysfs_get_string(d, "uevent", buf, 0))
+    for (line = buf; *line; line = next)
+      {
+	if (next = strchr(line, '\n'))
+	  *next++ = 0;
+	else
+	  next = line + strlen(line);
+	if (!(val = strchr(line, '=')))
+	  continue;
+	*val++ = 0;
+	if (!strcmp(line, "PCI_ID") && sscanf(val, "%x:%x", &x, &y) == 2)
+	  {
+	    d->vendor_id = x;
+	    d->device_id = y;
+	    known |= PCI_FILL_IDENT;
+	  }
+	else if (!strcmp(line, "PCI_CLASS") && sscanf(val, "%x", &x) == 1)
+	  {
+	    d->device_class = x >> 8;
+	    known |= PCI_FILL_CLASS;
+	  }
+	else if (!strcmp(line, "PCI_SUBSYS_ID") && sscanf(val, "%x:%x", &x, &y) == 2)
+	  {
+	    d->subsys_vendor_id = x;
+	    d->subsys_id = y;
+	    known |= PCI_FILL_SUBSYS;
+	  }
+	else if (!strcmp(line, "MODALIAS") && !sd->in_worker)
+	  {
+	    /* Workers cannot report failed allocations, so the alias is read later */
+	    d->module_alias = pci_set_property(d, PCI_FILL_MODULE_ALIAS, val);
+	    known |= PCI_FILL_MODULE_ALIAS;
+	  }
+      }
+
+  if (!(known & PCI_FILL_IDENT))
+    {
+      d->vendor_id = sysfs_get_value(d, "vendor", 1);
+      d->device_id = sysfs_get_value(d, "device", 1);
+    }
+  if (!(known & PCI_FILL_CLASS))
+    d->device_class = sysfs_get_value(d, "class", 1) >> 8;
+  return known | PCI_FILL_IDENT | PCI_FILL_CLASS;
+}
+
+/*
+ *  Reading the attributes of thousands of devices one by one is dominated
+ *  by the latency of system calls, so if asked to, we read the identity
+ *  of all devices in a pool of threads during the scan. Each thread takes
+ *  chunks of devices from a shared counter. Devices on which a worker
+ *  failed are read again by the calling thread, which reports the errors.
+ */
+
+#define SYSFS_CHUNK 16
+
+struct sysfs_pool {
+  struct pci_dev **devs;
+  unsigned int num_devs;
+  unsigned int next;
+};
+
+static void *
+sysfs_pool_worker(void *arg)
+{
+  struct sysfs_pool *pool = arg;
+  unsigned int i, end;
+
+  for (;;)
+    {
+#ifdef PCI_HAVE_PTHREAD
+      i = __atomic_fetch_add(&pool->next, SYSFS_CHUNK, __ATOMIC_RELAXED);
+#else
+      i = pool->next;
+      pool->next += SYSFS_CHUNK;
+#endif
+      if (i >= pool->num_devs)
+	return NULL;
+      end = (i + SYSFS_CHUNK < pool->num_devs) ? i + SYSFS_CHUNK : pool->num_devs;
+      for (; i < end; i++)
+	pool->devs[i]->known_fields = sysfs_get_ident(pool->devs[i]);
+    }
+}
+
+static void
+sysfs_fill_pool(struct pci_access *a, struct pci_dev **devs, unsigned int num_devs, int threads)
+{
+  struct sysfs_pool pool = { devs, num_devs, 0 };
+#ifdef PCI_HAVE_PTHREAD
+  pthread_t tids[64];
+  unsigned int j;
+  int i, n = 0;
+
+  if (threads > 64)
+    threads = 64;
+  if (threads > (int) (num_devs / SYSFS_CHUNK))
+    threads = num_devs / SYSFS_CHUNK;
+  for (j=0; j<num_devs; j++)
+    ((struct sysfs_dev *) devs[j]->aux)->in_worker = 1;
+  /* The calling thread is one of the workers */
+  while (n < threads - 1 && !pthread_create(&tids[n], NULL, sysfs_pool_worker, &pool))
+    n++;
+  a->debug("Reading %u devices in %d threads\n", num_devs, n + 1);
+  sysfs_pool_worker(&pool);
+  for (i=0; i<n; i++)
+    pthread_join(tids[i], NULL);
+  for (j=0; j<num_devs; j++)
+    {
+      struct sysfs_dev *sd = devs[j]->aux;
+      sd->in_worker = 0;
+      if (sd->failed)
+	{
+	  a->debug("Reading %04x:%02x:%02x.%d again\n", devs[j]->domain, devs[j]->bus, devs[j]->dev, devs[j]->func);
+	  sd->failed = 0;
+	  devs[j]->known_fields = sysfs_get_ident(devs[j]);
+	}
+    }
+#else
+  a->debug("Threads not supported, reading %u devices sequentially\n", num_devs);
+  sysfs_pool_worker(&pool);
+#endif
+}
+
 static void sysfs_scan(struct pci_access *a)
 {
   char dirname[1024];
   DIR *dir;
   struct dirent *entry;
-  int n;
+  int n, threads;
+  struct pci_dev **devs = NULL;
+  unsigned int num_devs = 0, max_devs = 0, i;
 
   n = snprintf(dirname, sizeof(dirname), "%s/devices", sysfs_name(a));
   if (n < 0 || n >= (int) sizeof(dirname))
@@ -202,6 +407,7 @@ static void sysfs_scan(struct pci_access *a)
   dir = opendir(dirname);
   if (!dir)
     a->error("Cannot open %s", dirname);
+  threads = a->buscentric ? 0 : atoi(pci_get_param(a, "sysfs.threads"));
   while ((entry = readdir(dir)))
     {
       struct pci_dev *d;
@@ -223,22 +429,37 @@ static void sysfs_scan(struct pci_access *a)
       d->bus = bus;
       d->dev = dev;
       d->func = func;
-      if (!a->buscentric)
+      if (threads > 0)
 	{
-	  sysfs_get_resources(d);
-	  d->irq = sysfs_get_value(d, "irq", 1);
-	  /*
-	   *  We could read these faster from the config registers, but we want to give
-	   *  the kernel a chance to fix up ID's and especially classes of broken devices.
-	   */
-	  d->vendor_id = sysfs_get_value(d, "vendor", 1);
-	  d->device_id = sysfs_get_value(d, "device", 1);
-	  d->device_class = sysfs_get_value(d, "class", 1) >> 8;
-	  d->known_fields = PCI_FILL_IDENT | PCI_FILL_CLASS | PCI_FILL_IRQ | PCI_FILL_BASES | PCI_FILL_ROM_BASE | PCI_FILL_SIZES | PCI_FILL_IO_FLAGS;
+	  if (num_devs >= max_devs)
+	    {
+	      struct pci_dev **old = devs;
+	      max_devs = max_devs ? 2*max_devs : 256;
+	      devs = pci_malloc(a, max_devs * sizeof(struct pci_dev *));
+	      if (old)
+		{
+		  memcpy(devs, old, num_devs * sizeof(struct pci_dev *));
+		  pci_mfree(old);
+		}
+	    }
+	  devs[num_devs++] = d;
+	}
+      else
+	{
+	  /* All attributes are read by sysfs_fill_info() only when asked for */
+	  pci_link_dev(a, d);
 	}
-      pci_link_dev(a, d);
     }
   closedir(dir);
+
+  if (num_devs)
+    {
+      sysfs_fill_pool(a, devs, num_devs, threads);
+      /* Link them in the same order as the sequential scan would */
+      for (i=0; i<num_devs; i++)
+	pci_link_dev(a, devs[i]);
+      pci_mfree(devs);
+    }
 }
 
 static void
@@ -301,9 +522,29 @@ sysfs_fill_slots(struct pci_access *a)
   closedir(dir);
 }
 
+#define SYSFS_RESOURCES (PCI_FILL_BASES | PCI_FILL_ROM_BASE | PCI_FILL_SIZES | PCI_FILL_IO_FLAGS)
+
 static int
 sysfs_fill_info(struct pci_dev *d, int flags)
 {
+  int done = 0;
+
+  if (!d->access->buscentric)
+    {
+      if (flags & (PCI_FILL_IDENT | PCI_FILL_CLASS | PCI_FILL_SUBSYS | PCI_FILL_MODULE_ALIAS))
+	done |= sysfs_get_ident(d);
+      if (flags & SYSFS_RESOURCES)
+	{
+	  sysfs_get_resources(d);
+	  done |= SYSFS_RESOURCES;
+	}
+      if (flags & PCI_FILL_IRQ)
+	{
+	  d->irq = sysfs_get_value(d, "irq", 1);
+	  done |= PCI_FILL_IRQ;
+	}
+    }
+
   if ((flags & PCI_FILL_PHYS_SLOT) && !(d->known_fields & PCI_FILL_PHYS_SLOT))
     {
       struct pci_dev *pd;
@@ -312,7 +553,7 @@ sysfs_fill_info(struct pci_dev *d, int flags)
 	pd->known_fields |= PCI_FILL_PHYS_SLOT;
     }
 
-  if ((flags & PCI_FILL_MODULE_ALIAS) && !(d->known_fields & PCI_FILL_MODULE_ALIAS))
+  if ((flags & PCI_FILL_MODULE_ALIAS) && !((d->known_fields | done) & PCI_FILL_MODULE_ALIAS))
     {
       char buf[OBJBUFSIZE];
       if (sysfs_get_string(d, "modalias", buf, 0))
@@ -339,7 +580,7 @@ sysfs_fill_info(struct pci_dev *d, int flags)
 	}
     }
 
-  return pci_generic_fill_info(d, flags);
+  return done | pci_generic_fill_info(d, flags & ~done);
 }
 
 /* Intent of the sysfs_setup() caller */
@@ -351,38 +592,38 @@ enum
   };
 
 static int
-sysfs_setup(struct pci_dev *d, int intent)
+sysfs_open_fd(struct pci_dev *d, int kind, int rw)
 {
-  struct pci_access *a = d->access;
   char namebuf[OBJNAMELEN];
+  int fd;
 
-  if (a->cached_dev != d || (intent == SETUP_WRITE_CONFIG && !a->fd_rw))
+  if (kind == PCI_FD_DIR)
     {
-      sysfs_flush_cache(a);
-      a->cached_dev = d;
+      sysfs_obj_name(d, "", namebuf);
+      return open(namebuf, O_PATH | O_DIRECTORY | O_CLOEXEC);
     }
 
-  if (intent == SETUP_READ_VPD)
-    {
-      if (a->fd_vpd < 0)
-	{
-	  sysfs_obj_name(d, "vpd", namebuf);
-	  a->fd_vpd = open(namebuf, O_RDONLY);
-	  /* No warning on error; vpd may be absent or accessible only to root */
-	}
-      return a->fd_vpd;
-    }
+  /* No warning on error; vpd may be absent or accessible only to root */
+  if (kind == PCI_FD_VPD)
+    return sysfs_open(d, "vpd", O_RDONLY);
 
-  if (a->fd < 0)
+  fd = sysfs_open(d, "config", rw ? O_RDWR : O_RDONLY);
+  if (fd < 0)
     {
       sysfs_obj_name(d, "config", namebuf);
-      a->fd_rw = a->writeable || intent == SETUP_WRITE_CONFIG;
-      a->fd = open(namebuf, a->fd_rw ? O_RDWR : O_RDONLY);
-      if (a->fd < 0)
-	a->warning("Cannot open %s", namebuf);
-      a->fd_pos = 0;
+      d->access->warning("Cannot open %s", namebuf);
     }
-  return a->fd;
+  return fd;
+}
+
+static int
+sysfs_setup(struct pci_dev *d, int intent)
+{
+  struct pci_access *a = d->access;
+
+  if (intent == SETUP_READ_VPD)
+    return pci_fd_get(d, PCI_FD_VPD, 0, sysfs_open_fd);
+  return pci_fd_get(d, PCI_FD_CONFIG, a->writeable || intent == SETUP_WRITE_CONFIG, sysfs_open_fd);
 }
 
 static int sysfs_read(struct pci_dev *d, int pos, byte *buf, int len)
@@ -455,12 +696,175 @@ static int sysfs_read_vpd(struct pci_dev *d, int pos, byte *buf, int len)
 
 #endif /* PCI_HAVE_DO_READ */
 
-static void sysfs_cleanup_dev(struct pci_dev *d)
+#ifdef PCI_HAVE_IO_URING
+
+/*
+ *  Batched reads: the config files which are not open yet are opened
+ *  in one submission to io_uring, then all reads go in another one.
+ *  The new files are put to the pool only afterwards, so that they cannot
+ *  be evicted in the middle. Operations the kernel does not know are
+ *  done synchronously.
+ */
+
+#define SYSFS_URING_MAX 1024
+
+struct sysfs_batch {
+  struct pci_read_request *reqs;
+  int *fds;
+  byte *opened;
+  int rw;
+};
+
+static void
+sysfs_batch_opened(void *data, u64 i, int res)
 {
-  struct pci_access *a = d->access;
+  struct sysfs_batch *b = data;
+  struct pci_dev *d = b->reqs[i].dev;
+  char namebuf[OBJNAMELEN];
+
+  /* Other operations can still use directories in the pool, so we must not change it */
+  sysfs_obj_name(d, "config", namebuf);
+  if (res == -EINVAL || res == -EOPNOTSUPP)
+    res = open(namebuf, b->rw ? O_RDWR : O_RDONLY);
+  else if (res < 0)
+    errno = -res;
+  if (res < 0)
+    d->access->warning("Cannot open %s", namebuf);
+  b->fds[i] = res;
+}
+
+static void
+sysfs_batch_read(void *data, u64 i, int res)
+{
+  struct sysfs_batch *b = data;
+  struct pci_read_request *r = &b->reqs[i];
+
+  if (res == -EINVAL || res == -EOPNOTSUPP)
+    res = pread(b->fds[i], r->buf, r->len, r->pos);
+  else if (res < 0)
+    errno = -res;
+  if (res < 0)
+    r->dev->access->warning("sysfs_read: read failed: %s", strerror(errno));
+  r->result = (res == r->len);
+}
+
+static int
+sysfs_uring_read(struct pci_access *a, struct pci_read_request *reqs, int n)
+{
+  struct pci_uring *r;
+  struct sysfs_batch b;
+  unsigned int max, queued = 0, waits = 0;
+  int i, ok = 1, flags = a->writeable ? O_RDWR : O_RDONLY;
+  int slot = strlen(sysfs_name(a)) + 40;
+  char *names = NULL;
+
+  r = pci_uring_open(a, (n < SYSFS_URING_MAX) ? n : SYSFS_URING_MAX);
+  if (!r)
+    return 0;
+  max = pci_uring_entries(r);
+  b.reqs = reqs;
+  b.fds = pci_malloc(a, n * sizeof(int));
+  b.opened = pci_malloc(a, n);
+  b.rw = a->writeable;
+
+  for (i=0; i<n; i++)
+    {
+      struct pci_dev *d = reqs[i].dev;
+      int dir_fd;
+      b.fds[i] = pci_fd_find(d, PCI_FD_CONFIG, b.rw);
+      b.opened[i] = (b.fds[i] < 0);
+      if (!b.opened[i])
+	continue;
+      if ((dir_fd = pci_fd_find(d, PCI_FD_DIR, 0)) >= 0)
+	pci_uring_openat(r, dir_fd, "config", flags, i);
+      else
+	{
+	  /* Not worth opening the directory just for this */
+	  char *name;
+	  if (!names)
+	    names = pci_malloc(a, n * slot);
+	  name = names + i * slot;
+	  snprintf(name, slot, "%s/devices/%04x:%02x:%02x.%d/config",
+		   sysfs_name(a), d->domain, d->bus, d->dev, d->func);
+	  pci_uring_openat(r, AT_FDCWD, name, flags, i);
+	}
+      if (++queued == max)
+	{
+	  ok = pci_uring_wait(r, sysfs_batch_opened, &b);
+	  waits++;
+	  queued = 0;
+	  if (!ok)
+	    break;
+	}
+    }
+  if (ok && queued)
+    {
+      ok = pci_uring_wait(r, sysfs_batch_opened, &b);
+      waits++;
+      queued = 0;
+    }
 
-  if (a->cached_dev == d)
-    sysfs_flush_cache(a);
+  for (i=0; ok && i<n; i++)
+    {
+      reqs[i].result = 0;
+      if (b.fds[i] < 0)
+	continue;
+      pci_uring_pread(r, b.fds[i], reqs[i].buf, reqs[i].len, reqs[i].pos, i);
+      if (++queued == max)
+	{
+	  ok = pci_uring_wait(r, sysfs_batch_read, &b);
+	  waits++;
+	  queued = 0;
+	}
+    }
+  if (ok && queued)
+    {
+      ok = pci_uring_wait(r, sysfs_batch_read, &b);
+      waits++;
+    }
+  pci_uring_close(r);
+
+  /* If anything failed, the caller reads all blocks synchronously */
+  for (i=0; i<n; i++)
+    if (b.opened[i] && b.fds[i] >= 0)
+      pci_fd_add(reqs[i].dev, PCI_FD_CONFIG, b.rw, b.fds[i]);
+  pci_mfree(b.fds);
+  pci_mfree(b.opened);
+  pci_mfree(names);
+  if (ok)
+    a->debug("Read %d blocks via io_uring in %u submissions\n", n, waits);
+  return ok;
+}
+
+#endif
+
+static void
+sysfs_read_batch(struct pci_access *a UNUSED, struct pci_read_request *reqs, int n)
+{
+  int i;
+
+#ifdef PCI_HAVE_IO_URING
+  if (n > 1 && sysfs_uring_read(a, reqs, n))
+    return;
+#endif
+  for (i=0; i<n; i++)
+    reqs[i].result = sysfs_read(reqs[i].dev, reqs[i].pos, reqs[i].buf, reqs[i].len);
+}
+
+static void sysfs_init_dev(struct pci_dev *d)
+{
+  struct sysfs_dev *sd = pci_malloc(d->access, sizeof(struct sysfs_dev));
+
+  sd->in_worker = 0;
+  sd->failed = 0;
+  d->aux = sd;
+}
+
+static void sysfs_cleanup_dev(struct pci_dev *d)
+{
+  pci_fd_close_dev(d);
+  pci_mfree(d->aux);
+  d->aux = NULL;
 }
 
 struct pci_methods pm_linux_sysfs = {
@@ -475,6 +879,7 @@ struct pci_methods pm_linux_sysfs = {
   sysfs_read,
   sysfs_write,
   sysfs_read_vpd,
-  NULL,					/* init_dev */
-  sysfs_cleanup_dev
+  sysfs_init_dev,
+  sysfs_cleanup_dev,
+  sysfs_read_batch
 };
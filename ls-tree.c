@@ -159,7 +159,6 @@ show_tree_dev(struct device *d, char *line, char *p)
 {
   struct pci_dev *q = d->dev;
   struct bridge *b;
-  char namebuf[256];
 
   p += sprintf(p, "%02x.%x", q->dev, q->func);
   for (b=&host_bridge; b; b=b->chain)
@@ -174,9 +173,8 @@ show_tree_dev(struct device *d, char *line, char *p)
       }
   if (verbose)
     p += sprintf(p, "  %s",
-		 pci_lookup_name(pacc, namebuf, sizeof(namebuf),
-				 PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE,
-				 q->vendor_id, q->device_id));
+		 lookup_dev_name(PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE,
+				 q->vendor_id, q->device_id, 0, 0));
   print_it(line, p);
 }
 
@@ -234,17 +232,17 @@ show_tree_bridge(struct bridge *b, char *line, char *p)
 }
 
 void
-show_forest(struct pci_filter *filter)
+show_forest(int filtered)
 {
   char line[256];
-  if (filter == NULL)
+  if (!filtered)
     show_tree_bridge(&host_bridge, line, line);
   else
     {
       struct bridge *b;
       for (b=&host_bridge; b; b=b->chain)
         {
-          if (b->br_dev && pci_filter_match(filter, b->br_dev->dev))
+          if (b->br_dev && filter_match(b->br_dev->dev))
             {
                 struct pci_dev *d = b->br_dev->dev;
                 char *p = line;
@@ -31,7 +31,7 @@ char *opt_pcimap;			/* Override path to Linux modules.pcimap */
 
 const char program_name[] = "lspci";
 
-static char options[] = "nvbxs:d:tPi:mgp:qkMDQ" GENERIC_OPTIONS ;
+static char options[] = "nvbxs:d:N:tPi:mgp:qkMDQ" GENERIC_OPTIONS ;
 
 static char help_msg[] =
 "Usage: lspci [<switches>]\n"
@@ -65,6 +65,8 @@ static char help_msg[] =
 "Selection of devices:\n"
 "-s [[[[<domain>]:]<bus>]:][<slot>][.[<func>]]\tShow only devices in selected slots\n"
 "-d [<vendor>]:[<device>][:<class>]\t\tShow only devices with specified ID's\n"
+"-N [<vendor>]:[<device>][:<class>]\t\tShow only devices whose names contain given strings\n"
+"-N <name>\tShow only devices whose vendor, device or class name contains <name>\n"
 "\n"
 "Other options:\n"
 "-i <file>\tUse specified ID database instead of %s\n"
@@ -84,6 +86,22 @@ struct device *first_dev;
 static int seen_errors;
 static int need_topology;
 
+static void
+config_reserve(struct device *d, unsigned int end)
+{
+  if (end > d->config_bufsize)
+    {
+      int orig_size = d->config_bufsize;
+      while (end > d->config_bufsize)
+	d->config_bufsize *= 2;
+      d->config = xrealloc(d->config, d->config_bufsize);
+      d->present = xrealloc(d->present, d->config_bufsize);
+      memset(d->present + orig_size, 0, d->config_bufsize - orig_size);
+      /* libpci must not keep using the old buffer */
+      pci_setup_cache(d->dev, d->config, d->config_cached);
+    }
+}
+
 int
 config_fetch(struct device *d, unsigned int pos, unsigned int len)
 {
@@ -97,29 +115,119 @@ config_fetch(struct device *d, unsigned int pos, unsigned int len)
   if (!len)
     return 1;
 
-  if (end > d->config_bufsize)
-    {
-      int orig_size = d->config_bufsize;
-      while (end > d->config_bufsize)
-	d->config_bufsize *= 2;
-      d->config = xrealloc(d->config, d->config_bufsize);
-      d->present = xrealloc(d->present, d->config_bufsize);
-      memset(d->present + orig_size, 0, d->config_bufsize - orig_size);
-    }
+  config_reserve(d, end);
   result = pci_read_block(d->dev, pos, d->config + pos, len);
   if (result)
     memset(d->present + pos, 1, len);
   return result;
 }
 
-struct device *
-scan_device(struct pci_dev *p)
+/*** Selection of devices by names ***/
+
+struct name_selector {
+  char *pattern;			/* NULL = any */
+  int flags;				/* Kinds of names to search (PCI_LOOKUP_xxx) */
+  struct pci_id_match *matches;
+  int count;
+};
+
+static struct name_selector name_filter[3];	/* Vendor, device, class; or a single one for any name */
+
+/* Name filter syntax: <name> or [<vendor>]:[<device>][:<class>] */
+
+static void
+set_name_selector(struct name_selector *s, char *str, int flags)
+{
+  if (str && str[0] && strcmp(str, "*"))
+    s->pattern = str;
+  s->flags = flags;
+}
+
+static void
+parse_name_filter(char *str)
+{
+  char *s, *c;
+
+  s = strchr(str, ':');
+  if (!s)
+    {
+      set_name_selector(&name_filter[0], str, PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_CLASS | PCI_LOOKUP_PROGIF);
+      return;
+    }
+  *s++ = 0;
+  c = strchr(s, ':');
+  if (c)
+    *c++ = 0;
+  set_name_selector(&name_filter[0], str, PCI_LOOKUP_VENDOR);
+  set_name_selector(&name_filter[1], s, PCI_LOOKUP_DEVICE);
+  set_name_selector(&name_filter[2], c, PCI_LOOKUP_CLASS | PCI_LOOKUP_PROGIF);
+}
+
+/* Translate the names to ID's, which needs the ID list and so it must be done after pci_init() */
+static void
+resolve_name_filter(void)
+{
+  struct name_selector *s;
+
+  for (s=name_filter; s < name_filter + 3; s++)
+    if (s->pattern)
+      {
+	s->count = pci_search_names(pacc, s->flags, s->pattern, NULL, 0);
+	s->matches = xmalloc(s->count * sizeof(struct pci_id_match) + 1);
+	pci_search_names(pacc, s->flags, s->pattern, s->matches, s->count);
+      }
+}
+
+static int
+match_id(struct pci_id_match *m, struct pci_dev *p)
+{
+  switch (m->flags)
+    {
+    case PCI_LOOKUP_VENDOR:
+      return m->vendor == p->vendor_id;
+    case PCI_LOOKUP_DEVICE:
+      return m->vendor == p->vendor_id && m->device == p->device_id;
+    case PCI_LOOKUP_CLASS:
+      return (p->device_class & m->class_mask) == m->device_class;
+    case PCI_LOOKUP_PROGIF:
+      return (p->device_class & m->class_mask) == m->device_class && pci_read_byte(p, PCI_CLASS_PROG) == m->prog_if;
+    default:
+      return 0;
+    }
+}
+
+static int
+match_names(struct pci_dev *p)
+{
+  struct name_selector *s;
+  int i;
+
+  for (s=name_filter; s < name_filter + 3; s++)
+    if (s->pattern)
+      {
+	pci_fill_info(p, PCI_FILL_IDENT | PCI_FILL_CLASS);
+	for (i=0; i < s->count && !match_id(&s->matches[i], p); i++)
+	  ;
+	if (i >= s->count)
+	  return 0;
+      }
+  return 1;
+}
+
+int
+filter_match(struct pci_dev *p)
+{
+  return pci_filter_match(&filter, p) && match_names(p);
+}
+
+static struct device *
+alloc_device(struct pci_dev *p)
 {
   struct device *d;
 
   if (p->domain && !opt_domains)
     opt_domains = 1;
-  if (!pci_filter_match(&filter, p) && !need_topology)
+  if (!filter_match(p) && !need_topology)
     return NULL;
   d = xmalloc(sizeof(struct device));
   memset(d, 0, sizeof(*d));
@@ -128,7 +236,16 @@ scan_device(struct pci_dev *p)
   d->config = xmalloc(64);
   d->present = xmalloc(64);
   memset(d->present, 1, 64);
-  if (!pci_read_block(p, 0, d->config, 64))
+  return d;
+}
+
+/* Called once the first 64 bytes of the config space have been read (or not) */
+static struct device *
+finish_device(struct device *d, int header_ok)
+{
+  struct pci_dev *p = d->dev;
+
+  if (!header_ok)
     {
       fprintf(stderr, "lspci: Unable to read the standard configuration space header of device %04x:%02x:%02x.%d\n",
 	      p->domain, p->bus, p->dev, p->func);
@@ -147,19 +264,52 @@ scan_device(struct pci_dev *p)
   return d;
 }
 
+struct device *
+scan_device(struct pci_dev *p)
+{
+  struct device *d = alloc_device(p);
+
+  if (!d)
+    return NULL;
+  return finish_device(d, pci_read_block(p, 0, d->config, 64));
+}
+
 static void
 scan_devices(void)
 {
-  struct device *d;
+  struct device *d, **devs;
   struct pci_dev *p;
+  struct pci_read_request *reqs;
+  int i, n = 0;
 
   pci_scan_bus(pacc);
   for (p=pacc->devices; p; p=p->next)
-    if (d = scan_device(p))
+    n++;
+  devs = xmalloc(n * sizeof(struct device *) + 1);
+  reqs = xmalloc(n * sizeof(struct pci_read_request) + 1);
+
+  /* Headers of all devices are read at once */
+  n = 0;
+  for (p=pacc->devices; p; p=p->next)
+    if (d = alloc_device(p))
+      {
+	devs[n] = d;
+	reqs[n].dev = p;
+	reqs[n].pos = 0;
+	reqs[n].buf = d->config;
+	reqs[n].len = 64;
+	n++;
+      }
+  pci_read_blocks(pacc, reqs, n);
+
+  for (i=0; i<n; i++)
+    if (d = finish_device(devs[i], reqs[i].result))
       {
 	d->next = first_dev;
 	first_dev = d;
       }
+  free(devs);
+  free(reqs);
 }
 
 /*** Config space accesses ***/
@@ -250,6 +400,79 @@ sort_them(void)
   *last_dev = NULL;
 }
 
+/*** Names ***/
+
+/*
+ *  Machines with many identical functions (e.g., SR-IOV virtual functions)
+ *  ask for the same names over and over, so we remember all names looked
+ *  up during the run. Names which need no numeric decoration point directly
+ *  to the name database, only the others are formatted by pci_lookup_name().
+ */
+
+struct name_memo {
+  struct name_memo *next;
+  int flags;
+  int args[4];
+  const char *name;			/* NULL if PCI_LOOKUP_NO_NUMBERS was given and the name is unknown */
+};
+
+#define NAME_MEMO_SIZE 1024
+static struct name_memo *name_memo[NAME_MEMO_SIZE];
+
+static const char *
+lookup_name_uncached(int flags, int arg1, int arg2, int arg3, int arg4)
+{
+  const char *name, *v, *d;
+  char buf[256], *res;
+
+  if (!pacc->numeric_ids || (flags & PCI_LOOKUP_NO_NUMBERS))
+    {
+      if (flags == (PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE))
+	{
+	  if ((v = pci_lookup_raw_name(pacc, NULL, PCI_LOOKUP_VENDOR, arg1)) &&
+	      (d = pci_lookup_raw_name(pacc, NULL, PCI_LOOKUP_DEVICE, arg1, arg2)))
+	    {
+	      res = xmalloc(strlen(v) + strlen(d) + 2);
+	      sprintf(res, "%s %s", v, d);
+	      return res;
+	    }
+	}
+      else if (name = pci_lookup_raw_name(pacc, NULL, flags & ~PCI_LOOKUP_NO_NUMBERS, arg1, arg2, arg3, arg4))
+	return name;
+    }
+  if (!pci_lookup_name(pacc, buf, sizeof(buf), flags, arg1, arg2, arg3, arg4))
+    return NULL;
+  return xstrdup(buf);
+}
+
+/* Arguments not used by the given kind of name must be zero */
+const char *
+lookup_dev_name(int flags, int arg1, int arg2, int arg3, int arg4)
+{
+  unsigned int h = flags;
+  struct name_memo *m;
+
+  h = h*0x9e3779b1 + arg1;
+  h = h*0x9e3779b1 + arg2;
+  h = h*0x9e3779b1 + arg3;
+  h = h*0x9e3779b1 + arg4;
+  h = (h * 0x9e3779b1) >> 22;
+  for (m = name_memo[h]; m; m = m->next)
+    if (m->flags == flags && m->args[0] == arg1 && m->args[1] == arg2 && m->args[2] == arg3 && m->args[3] == arg4)
+      return m->name;
+
+  m = xmalloc(sizeof(*m));
+  m->flags = flags;
+  m->args[0] = arg1;
+  m->args[1] = arg2;
+  m->args[2] = arg3;
+  m->args[3] = arg4;
+  m->name = lookup_name_uncached(flags, arg1, arg2, arg3, arg4);
+  m->next = name_memo[h];
+  name_memo[h] = m;
+  return m->name;
+}
+
 /*** Normal output ***/
 
 static void
@@ -309,25 +532,18 @@ show_terse(struct device *d)
 {
   int c;
   struct pci_dev *p = d->dev;
-  char classbuf[128], devbuf[128];
 
   show_slot_name(d);
   printf(" %s: %s",
-	 pci_lookup_name(pacc, classbuf, sizeof(classbuf),
-			 PCI_LOOKUP_CLASS,
-			 p->device_class),
-	 pci_lookup_name(pacc, devbuf, sizeof(devbuf),
-			 PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE,
-			 p->vendor_id, p->device_id));
+	 lookup_dev_name(PCI_LOOKUP_CLASS, p->device_class, 0, 0, 0),
+	 lookup_dev_name(PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, 0, 0));
   if (c = get_conf_byte(d, PCI_REVISION_ID))
     printf(" (rev %02x)", c);
   if (verbose)
     {
-      char *x;
+      const char *x;
       c = get_conf_byte(d, PCI_CLASS_PROG);
-      x = pci_lookup_name(pacc, devbuf, sizeof(devbuf),
-			  PCI_LOOKUP_PROGIF | PCI_LOOKUP_NO_NUMBERS,
-			  p->device_class, c);
+      x = lookup_dev_name(PCI_LOOKUP_PROGIF | PCI_LOOKUP_NO_NUMBERS, p->device_class, c, 0, 0);
       if (c || x)
 	{
 	  printf(" (prog-if %02x", c);
@@ -341,7 +557,6 @@ show_terse(struct device *d)
   if (verbose || opt_kernel)
     {
       word subsys_v, subsys_d;
-      char ssnamebuf[256];
 
       pci_fill_info(p, PCI_FILL_LABEL);
 
@@ -350,9 +565,8 @@ show_terse(struct device *d)
       get_subid(d, &subsys_v, &subsys_d);
       if (subsys_v && subsys_v != 0xffff)
 	printf("\tSubsystem: %s\n",
-		pci_lookup_name(pacc, ssnamebuf, sizeof(ssnamebuf),
-			PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE,
-			p->vendor_id, p->device_id, subsys_v, subsys_d));
+		lookup_dev_name(PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE,
+				p->vendor_id, p->device_id, subsys_v, subsys_d));
     }
 }
 
@@ -876,7 +1090,7 @@ show_hex_dump(struct device *d)
 }
 
 static void
-print_shell_escaped(char *c)
+print_shell_escaped(const char *c)
 {
   printf(" \"");
   while (*c)
@@ -894,7 +1108,6 @@ show_machine(struct device *d)
   struct pci_dev *p = d->dev;
   int c;
   word sv_id, sd_id;
-  char classbuf[128], vendbuf[128], devbuf[128], svbuf[128], sdbuf[128];
   char *dt_node;
 
   get_subid(d, &sv_id, &sd_id);
@@ -906,17 +1119,17 @@ show_machine(struct device *d)
       show_slot_name(d);
       putchar('\n');
       printf("Class:\t%s\n",
-	     pci_lookup_name(pacc, classbuf, sizeof(classbuf), PCI_LOOKUP_CLASS, p->device_class));
+	     lookup_dev_name(PCI_LOOKUP_CLASS, p->device_class, 0, 0, 0));
       printf("Vendor:\t%s\n",
-	     pci_lookup_name(pacc, vendbuf, sizeof(vendbuf), PCI_LOOKUP_VENDOR, p->vendor_id, p->device_id));
+	     lookup_dev_name(PCI_LOOKUP_VENDOR, p->vendor_id, 0, 0, 0));
       printf("Device:\t%s\n",
-	     pci_lookup_name(pacc, devbuf, sizeof(devbuf), PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id));
+	     lookup_dev_name(PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, 0, 0));
       if (sv_id && sv_id != 0xffff)
 	{
 	  printf("SVendor:\t%s\n",
-		 pci_lookup_name(pacc, svbuf, sizeof(svbuf), PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR, sv_id));
+		 lookup_dev_name(PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR, sv_id, 0, 0, 0));
 	  printf("SDevice:\t%s\n",
-		 pci_lookup_name(pacc, sdbuf, sizeof(sdbuf), PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, sv_id, sd_id));
+		 lookup_dev_name(PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, sv_id, sd_id));
 	}
       if (p->phy_slot)
 	printf("PhySlot:\t%s\n", p->phy_slot);
@@ -934,17 +1147,17 @@ show_machine(struct device *d)
   else
     {
       show_slot_name(d);
-      print_shell_escaped(pci_lookup_name(pacc, classbuf, sizeof(classbuf), PCI_LOOKUP_CLASS, p->device_class));
-      print_shell_escaped(pci_lookup_name(pacc, vendbuf, sizeof(vendbuf), PCI_LOOKUP_VENDOR, p->vendor_id, p->device_id));
-      print_shell_escaped(pci_lookup_name(pacc, devbuf, sizeof(devbuf), PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id));
+      print_shell_escaped(lookup_dev_name(PCI_LOOKUP_CLASS, p->device_class, 0, 0, 0));
+      print_shell_escaped(lookup_dev_name(PCI_LOOKUP_VENDOR, p->vendor_id, 0, 0, 0));
+      print_shell_escaped(lookup_dev_name(PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, 0, 0));
       if (c = get_conf_byte(d, PCI_REVISION_ID))
 	printf(" -r%02x", c);
       if (c = get_conf_byte(d, PCI_CLASS_PROG))
 	printf(" -p%02x", c);
       if (sv_id && sv_id != 0xffff)
 	{
-	  print_shell_escaped(pci_lookup_name(pacc, svbuf, sizeof(svbuf), PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR, sv_id));
-	  print_shell_escaped(pci_lookup_name(pacc, sdbuf, sizeof(sdbuf), PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, sv_id, sd_id));
+	  print_shell_escaped(lookup_dev_name(PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR, sv_id, 0, 0, 0));
+	  print_shell_escaped(lookup_dev_name(PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE, p->vendor_id, p->device_id, sv_id, sd_id));
 	}
       else
 	printf(" \"\" \"\"");
@@ -974,16 +1187,128 @@ show_device(struct device *d)
     putchar('\n');
 }
 
+/*
+ *  Hex dumps of the whole config space need all of it anyway, so we read it
+ *  for all devices at once. If this fails (e.g., the extended config space
+ *  is not available), show_hex_dump() falls back to reading it in steps.
+ */
+static void
+prefetch_config(void)
+{
+  struct device *d, **devs;
+  struct pci_read_request *reqs;
+  unsigned int len = (opt_hex >= 4) ? 4096 : 256;
+  int i, n = 0;
+
+  for (d=first_dev; d; d=d->next)
+    n++;
+  devs = xmalloc(n * sizeof(struct device *) + 1);
+  reqs = xmalloc(n * sizeof(struct pci_read_request) + 1);
+  n = 0;
+  for (d=first_dev; d; d=d->next)
+    if (filter_match(d->dev) && d->config_cached < len)
+      {
+	config_reserve(d, len);
+	devs[n] = d;
+	reqs[n].dev = d->dev;
+	reqs[n].pos = d->config_cached;
+	reqs[n].buf = d->config + d->config_cached;
+	reqs[n].len = len - d->config_cached;
+	n++;
+      }
+  pci_read_blocks(pacc, reqs, n);
+  for (i=0; i<n; i++)
+    if (reqs[i].result)
+      memset(devs[i]->present + reqs[i].pos, 1, reqs[i].len);
+  free(devs);
+  free(reqs);
+}
+
 static void
 show(void)
 {
   struct device *d;
 
+  if (opt_hex >= 3)
+    prefetch_config();
   for (d=first_dev; d; d=d->next)
-    if (pci_filter_match(&filter, d->dev))
+    if (filter_match(d->dev))
       show_device(d);
 }
 
+/*** Looking up names in advance ***/
+
+/*
+ *  Look up all names we are going to need in a single batch, so that
+ *  the library can query the HWDB in bulk and send the DNS queries
+ *  concurrently. The results are remembered by the library, so they are
+ *  found again when the devices are shown. We ask only for the names
+ *  the show functions are going to print.
+ */
+static void
+preload_names(void)
+{
+  struct device *d;
+  struct pci_lookup_request *reqs, *r;
+  char buf[256];
+  word subsys_v, subsys_d;
+  int numeric = (pacc->numeric_ids == 1);	/* Only NO_NUMBERS lookups give names */
+  int n = 0;
+
+  if (opt_tree && (!verbose || numeric))
+    return;
+  for (d=first_dev; d; d=d->next)
+    n++;
+  r = reqs = xmalloc(4 * n * sizeof(struct pci_lookup_request) + 1);
+  for (d=first_dev; d; d=d->next)
+    {
+      struct pci_dev *p = d->dev;
+      if (!filter_match(p))
+	continue;
+      if (!numeric)
+	{
+	  r->flags = PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE;
+	  r->args[0] = p->vendor_id;
+	  r->args[1] = p->device_id;
+	  r++;
+	}
+      if (opt_tree)			/* The tree shows only device names */
+	continue;
+      if (!numeric)
+	{
+	  r->flags = PCI_LOOKUP_CLASS;
+	  r->args[0] = p->device_class;
+	  r++;
+	}
+      if (verbose && !opt_machine)
+	{
+	  r->flags = PCI_LOOKUP_PROGIF | PCI_LOOKUP_NO_NUMBERS;
+	  r->args[0] = p->device_class;
+	  r->args[1] = get_conf_byte(d, PCI_CLASS_PROG);
+	  r++;
+	}
+      if (numeric || !(opt_machine || verbose || opt_kernel))
+	continue;
+      get_subid(d, &subsys_v, &subsys_d);
+      if (subsys_v && subsys_v != 0xffff)
+	{
+	  r->flags = PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE;
+	  r->args[0] = p->vendor_id;
+	  r->args[1] = p->device_id;
+	  r->args[2] = subsys_v;
+	  r->args[3] = subsys_d;
+	  r++;
+	}
+    }
+  for (n=0; reqs+n < r; n++)
+    {
+      reqs[n].buf = buf;
+      reqs[n].size = sizeof(buf);
+    }
+  pci_lookup_names_batch(pacc, reqs, n);
+  free(reqs);
+}
+
 /* Main */
 
 int
@@ -1024,6 +1349,10 @@ main(int argc, char **argv)
 	  die("-d: %s", msg);
 	opt_filter = 1;
 	break;
+      case 'N':
+	parse_name_filter(optarg);
+	opt_filter = 1;
+	break;
       case 'x':
 	opt_hex++;
 	break;
@@ -1087,6 +1416,7 @@ main(int argc, char **argv)
     pacc->id_lookup_mode |= PCI_LOOKUP_NETWORK | PCI_LOOKUP_SKIP_LOCAL;
 
   pci_init(pacc);
+  resolve_name_filter();
   if (opt_map_mode)
     {
       if (need_topology)
@@ -1097,10 +1427,11 @@ main(int argc, char **argv)
     {
       scan_devices();
       sort_them();
+      preload_names();
       if (need_topology)
 	grow_tree();
       if (opt_tree)
-	show_forest(opt_filter ? &filter : NULL);
+	show_forest(opt_filter);
       else
 	show();
     }
@@ -27,6 +27,7 @@
 
 extern int verbose;
 extern struct pci_filter filter;
+int filter_match(struct pci_dev *p);
 extern char *opt_pcimap;
 
 /*** PCI devices and access to their config space ***/
@@ -56,6 +57,7 @@ word get_conf_word(struct device *d, unsigned int pos);
 byte get_conf_byte(struct device *d, unsigned int pos);
 
 void get_subid(struct device *d, word *subvp, word *subdp);
+const char *lookup_dev_name(int flags, int arg1, int arg2, int arg3, int arg4);
 
 /* Useful macros for decoding of bits and bit fields */
 
@@ -107,7 +109,7 @@ struct bus {
 extern struct bridge host_bridge;
 
 void grow_tree(void);
-void show_forest(struct pci_filter *filter);
+void show_forest(int filtered);
 
 /* ls-map.c */
 
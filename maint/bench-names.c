@@ -0,0 +1,339 @@
+/*
+ *	The PCI Library -- Microbenchmark of the ID Hash
+ *
+ *	Compares insert and lookup throughput of the open-addressing hash
+ *	in names-hash.c with the chained table used by pciutils 3.7 and
+ *	older, which is reproduced below. Both are fed with vendor, device
+ *	and subsystem entries of an uncompressed ID list.
+ *
+ *	With -l, it measures how long pci_load_name_list() takes to parse
+ *	each of the given ID lists (plain or compressed), both entirely
+ *	and lazily.
+ *
+ *	Usage: maint/bench-names [<pci.ids> [<rounds>]]
+ *	       maint/bench-names -l <rounds> <pci.ids>...
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
+
+#include "../lib/internal.h"
+#include "../lib/names.h"
+
+struct key {
+  int cat, id1, id2, id3, id4;
+  char *name;
+};
+
+static struct key *keys;
+static int num_keys, max_keys;
+
+static void
+add_key(int cat, int id1, int id2, int id3, int id4, char *name)
+{
+  struct key *k;
+
+  if (num_keys >= max_keys)
+    {
+      max_keys = max_keys ? 2*max_keys : 65536;
+      keys = realloc(keys, max_keys * sizeof(struct key));
+      if (!keys)
+	{
+	  fprintf(stderr, "Out of memory\n");
+	  exit(1);
+	}
+    }
+  k = &keys[num_keys++];
+  k->cat = cat;
+  k->id1 = id1;
+  k->id2 = id2;
+  k->id3 = id3;
+  k->id4 = id4;
+  k->name = strdup(name);
+}
+
+/* Only vendors, devices and subsystems, which are the bulk of the list */
+static void
+read_keys(char *name)
+{
+  FILE *f = fopen(name, "r");
+  char line[1024], *p;
+  int vendor = -1, device = -1, a, b, n;
+
+  if (!f)
+    {
+      perror(name);
+      exit(1);
+    }
+  while (fgets(line, sizeof(line), f))
+    {
+      if (p = strchr(line, '\n'))
+	*p = 0;
+      if (!line[0] || line[0] == '#')
+	continue;
+      if (line[0] == 'C' && line[1] == ' ')
+	break;
+      if (line[0] != '\t' && sscanf(line, "%x %n", &a, &n) == 1)
+	{
+	  add_key(ID_VENDOR, a, 0, 0, 0, line + n);
+	  vendor = a;
+	}
+      else if (line[0] == '\t' && line[1] != '\t' && sscanf(line+1, "%x %n", &a, &n) == 1 && vendor >= 0)
+	{
+	  add_key(ID_DEVICE, vendor, a, 0, 0, line + 1 + n);
+	  device = a;
+	}
+      else if (line[0] == '\t' && line[1] == '\t' && sscanf(line+2, "%x %x %n", &a, &b, &n) == 2 && device >= 0)
+	add_key(ID_SUBSYSTEM, vendor, device, a, b, line + 2 + n);
+    }
+  fclose(f);
+}
+
+/* The chained table */
+
+#define OLD_HASH_SIZE 4099
+
+struct old_entry {
+  struct old_entry *next;
+  u32 id12, id34;
+  byte cat;
+  byte src;
+  char name[1];
+};
+
+static struct old_entry *old_hash[OLD_HASH_SIZE];
+
+/* Entries were allocated from 8 KB buckets */
+struct old_bucket {
+  struct old_bucket *next;
+  unsigned int full;
+};
+
+static struct old_bucket *old_buckets;
+
+static void *
+old_alloc(unsigned int size)
+{
+  struct old_bucket *b = old_buckets;
+  void *p;
+
+  size = (size + 7) & ~7U;
+  if (!b || b->full + size > BUCKET_SIZE)
+    {
+      b = malloc(BUCKET_SIZE);
+      b->next = old_buckets;
+      b->full = sizeof(struct old_bucket);
+      old_buckets = b;
+    }
+  p = (byte *) b + b->full;
+  b->full += size;
+  return p;
+}
+
+static inline unsigned int
+old_hash_fn(int cat, u32 id12, u32 id34)
+{
+  return (id12 ^ (id34 << 3) ^ (cat << 5)) % OLD_HASH_SIZE;
+}
+
+static void
+old_insert(int cat, int id1, int id2, int id3, int id4, char *text)
+{
+  u32 id12 = id_pair(id1, id2), id34 = id_pair(id3, id4);
+  unsigned int h = old_hash_fn(cat, id12, id34);
+  struct old_entry *n = old_hash[h];
+  int len = strlen(text);
+
+  while (n && (n->id12 != id12 || n->id34 != id34 || n->cat != cat))
+    n = n->next;
+  if (n)
+    return;
+  n = old_alloc(sizeof(struct old_entry) + len);
+  n->id12 = id12;
+  n->id34 = id34;
+  n->cat = cat;
+  n->src = SRC_LOCAL;
+  memcpy(n->name, text, len+1);
+  n->next = old_hash[h];
+  old_hash[h] = n;
+}
+
+static char *
+old_lookup(int cat, int id1, int id2, int id3, int id4)
+{
+  u32 id12 = id_pair(id1, id2), id34 = id_pair(id3, id4);
+  struct old_entry *n, *best = NULL;
+
+  for (n = old_hash[old_hash_fn(cat, id12, id34)]; n; n=n->next)
+    if (n->id12 == id12 && n->id34 == id34 && n->cat == cat && (!best || best->src < n->src))
+      best = n;
+  return best ? best->name : NULL;
+}
+
+static void
+old_free(void)
+{
+  struct old_bucket *b;
+
+  memset(old_hash, 0, sizeof(old_hash));
+  while (b = old_buckets)
+    {
+      old_buckets = b->next;
+      free(b);
+    }
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Parsing of whole ID lists */
+
+static jmp_buf load_failed;
+
+static void
+load_error(char *msg, ...)
+{
+  va_list args;
+
+  va_start(args, msg);
+  fputs("\t", stdout);
+  vprintf(msg, args);
+  if (!*msg || msg[strlen(msg)-1] != '\n')
+    putchar('\n');
+  va_end(args);
+  longjmp(load_failed, 1);
+}
+
+static double
+time_load(char *name, int lazy)
+{
+  struct pci_access *a = pci_alloc();
+  double t;
+
+  /* We need no devices */
+  a->method = PCI_ACCESS_DUMP;
+  pci_set_param(a, "dump.name", "/dev/null");
+  pci_set_param(a, "names.lazy", lazy ? "1" : "0");
+  a->error = load_error;
+  pci_init(a);
+  pci_set_name_list_path(a, name, 0);
+  t = now();
+  if (!pci_load_name_list(a))
+    load_error("Cannot open %s", name);
+  t = now() - t;
+  pci_cleanup(a);
+  return t;
+}
+
+/* Returns 0 if the list cannot be loaded */
+static int
+best_load(char *name, int rounds, double *best)
+{
+  double t;
+  int r, lazy;
+
+  if (setjmp(load_failed))
+    return 0;
+  for (lazy=0; lazy<2; lazy++)
+    {
+      best[lazy] = 1e30;
+      for (r=0; r<rounds; r++)
+	if ((t = time_load(name, lazy)) < best[lazy])
+	  best[lazy] = t;
+    }
+  return 1;
+}
+
+static int
+bench_load(int rounds, char **names, int num_names)
+{
+  double best[2];
+  int i;
+
+  printf("Loading of ID lists, best of %d rounds\n", rounds);
+  for (i=0; i<num_names; i++)
+    if (best_load(names[i], rounds, best))
+      printf("%-32s whole %7.2f ms, lazy %7.2f ms\n", names[i], best[0] / 1e6, best[1] / 1e6);
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+  int r, i, old_found = 0, new_found = 0;
+  double t, old_ins = 1e30, old_look = 1e30, new_ins = 1e30, new_look = 1e30;
+
+  if (argc > 1 && !strcmp(argv[1], "-l"))
+    {
+      if (argc < 4 || (rounds = atoi(argv[2])) < 1)
+	{
+	  fprintf(stderr, "Usage: maint/bench-names -l <rounds> <pci.ids>...\n");
+	  return 2;
+	}
+      return bench_load(rounds, argv + 3, argc - 3);
+    }
+
+  read_keys((argc > 1) ? argv[1] : "pci.ids");
+  printf("%d entries, lookups of all of them and as many misses, best of %d rounds\n", num_keys, rounds);
+
+  for (r=0; r<rounds; r++)
+    {
+      struct pci_access *a;
+
+      t = now();
+      for (i=0; i<num_keys; i++)
+	old_insert(keys[i].cat, keys[i].id1, keys[i].id2, keys[i].id3, keys[i].id4, keys[i].name);
+      t = now() - t;
+      if (t < old_ins)
+	old_ins = t;
+      old_found = 0;
+      t = now();
+      for (i=0; i<num_keys; i++)
+	{
+	  old_found += !!old_lookup(keys[i].cat, keys[i].id1, keys[i].id2, keys[i].id3, keys[i].id4);
+	  old_found += !!old_lookup(keys[i].cat, keys[i].id1, keys[i].id2 ^ 0x8000, keys[i].id3, keys[i].id4);
+	}
+      t = now() - t;
+      if (t < old_look)
+	old_look = t;
+      old_free();
+
+      a = pci_alloc();
+      t = now();
+      for (i=0; i<num_keys; i++)
+	pci_id_insert(a, keys[i].cat, keys[i].id1, keys[i].id2, keys[i].id3, keys[i].id4, keys[i].name, SRC_LOCAL);
+      t = now() - t;
+      if (t < new_ins)
+	new_ins = t;
+      new_found = 0;
+      t = now();
+      for (i=0; i<num_keys; i++)
+	{
+	  new_found += !!pci_id_lookup(a, 0, keys[i].cat, keys[i].id1, keys[i].id2, keys[i].id3, keys[i].id4);
+	  new_found += !!pci_id_lookup(a, 0, keys[i].cat, keys[i].id1, keys[i].id2 ^ 0x8000, keys[i].id3, keys[i].id4);
+	}
+      t = now() - t;
+      if (t < new_look)
+	new_look = t;
+      pci_cleanup(a);
+    }
+
+  printf("chained table:   insert %6.1f ns, lookup %6.1f ns (%d found)\n", old_ins / num_keys, old_look / (2*num_keys), old_found);
+  printf("open addressing: insert %6.1f ns, lookup %6.1f ns (%d found)\n", new_ins / num_keys, new_look / (2*num_keys), new_found);
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ *	The PCI Library -- Stress Test of Concurrent Name Lookups
+ *
+ *	Several threads look up names of random IDs in a single pci_access,
+ *	so that lock-free lookups run while other threads insert entries
+ *	and resize the hash (the ID list is loaded lazily by default).
+ *	The results are compared with those of a single-threaded pass.
+ *
+ *	Usage: stress-names [<pci.ids> [<threads> [<lookups per thread> [<param>=<value> ...]]]]
+ *
+ *	Copyright (c) 2026 agent <agent@local>
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "lib/pci.h"
+
+#define NUM_KEYS 4096
+#define MAX_THREADS 64
+
+struct key {
+  int kind;
+  int id1, id2, id3, id4;
+  char *expected;
+};
+
+static struct key keys[NUM_KEYS];
+static struct pci_access *pacc;
+static int lookups;
+static int errors;
+
+static char *
+lookup(struct pci_access *a, char *buf, int size, int flags, struct key *k)
+{
+  switch (k->kind)
+    {
+    case 0:
+      return pci_lookup_name(a, buf, size, flags | PCI_LOOKUP_VENDOR, k->id1);
+    case 1:
+      return pci_lookup_name(a, buf, size, flags | PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE, k->id1, k->id2);
+    case 2:
+      return pci_lookup_name(a, buf, size, flags | PCI_LOOKUP_SUBSYSTEM | PCI_LOOKUP_DEVICE, k->id1, k->id2, k->id3, k->id4);
+    default:
+      return pci_lookup_name(a, buf, size, flags | PCI_LOOKUP_CLASS, k->id1);
+    }
+}
+
+static void
+make_keys(void)
+{
+  int i, vendor;
+
+  /* Mostly well-known vendors, so that many lookups hit */
+  srand(1);
+  for (i=0; i<NUM_KEYS; i++)
+    {
+      struct key *k = &keys[i];
+      if (rand() % 4)
+	vendor = (rand() & 1) ? 0x8086 : 0x10de;
+      else
+	vendor = rand() & 0xffff;
+      k->kind = rand() % 4;
+      k->id1 = (k->kind == 3) ? rand() & 0xffff : vendor;
+      k->id2 = (rand() % 5) ? 0x9d10 + rand() % 64 : rand() & 0xffff;
+      k->id3 = vendor;
+      k->id4 = rand() & 0xffff;
+    }
+}
+
+static struct pci_access *
+make_access(char *ids, char **params, int num_params)
+{
+  struct pci_access *a = pci_alloc();
+  int i;
+
+  /* We do not need any devices, so use an empty dump */
+  a->method = PCI_ACCESS_DUMP;
+  pci_set_param(a, "dump.name", "/dev/null");
+  pci_set_param(a, "names.lazy", "1");
+  for (i=0; i<num_params; i++)
+    {
+      char *p = strdup(params[i]), *v = strchr(p, '=');
+      if (!v)
+	{
+	  fprintf(stderr, "Invalid parameter %s\n", p);
+	  exit(2);
+	}
+      *v++ = 0;
+      if (pci_set_param(a, p, v) < 0)
+	{
+	  fprintf(stderr, "Unknown parameter %s\n", p);
+	  exit(2);
+	}
+      free(p);
+    }
+  pci_init(a);
+  pci_set_name_list_path(a, ids, 0);
+  return a;
+}
+
+static void *
+worker(void *arg)
+{
+  unsigned int seed = (unsigned long) arg * 7919 + 1;
+  char buf[256], *name;
+  int i;
+
+  for (i=0; i<lookups; i++)
+    {
+      struct key *k;
+      seed = seed * 1103515245 + 12345;
+      k = &keys[(seed >> 8) % NUM_KEYS];
+      name = lookup(pacc, buf, sizeof(buf), 0, k);
+      if (strcmp(name, k->expected) && __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED) <= 5)
+	fprintf(stderr, "Mismatch: got <%s>, expected <%s>\n", name, k->expected);
+    }
+  return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+  char *ids = (argc > 1) ? argv[1] : "pci.ids";
+  int threads = (argc > 2) ? atoi(argv[2]) : 8;
+  int num_params = (argc > 4) ? argc - 4 : 0;
+  pthread_t tids[MAX_THREADS];
+  struct pci_access *ref;
+  char buf[256];
+  int i, known;
+
+  lookups = (argc > 3) ? atoi(argv[3]) : 100000;
+  if (threads < 1 || threads > MAX_THREADS || lookups < 1)
+    {
+      fprintf(stderr, "Usage: stress-names [<pci.ids> [<threads> [<lookups per thread> [<param>=<value> ...]]]]\n");
+      return 2;
+    }
+  make_keys();
+
+  /* Expected results from a separate single-threaded pass */
+  ref = make_access(ids, argv + 4, num_params);
+  known = 0;
+  for (i=0; i<NUM_KEYS; i++)
+    {
+      keys[i].expected = strdup(lookup(ref, buf, sizeof(buf), 0, &keys[i]));
+      known += !!lookup(ref, buf, sizeof(buf), PCI_LOOKUP_NO_NUMBERS, &keys[i]);
+    }
+  pci_cleanup(ref);
+  if (!known)
+    {
+      fprintf(stderr, "No IDs found in %s\n", ids);
+      return 1;
+    }
+
+  pacc = make_access(ids, argv + 4, num_params);
+  for (i=0; i<threads; i++)
+    if (pthread_create(&tids[i], NULL, worker, (void *)(long) i))
+      {
+	fprintf(stderr, "Cannot create thread\n");
+	return 1;
+      }
+  for (i=0; i<threads; i++)
+    pthread_join(tids[i], NULL);
+  pci_cleanup(pacc);
+
+  printf("%d threads, %d lookups each of %d IDs (%d known): %d errors\n", threads, lookups, NUM_KEYS, known, errors);
+  return errors != 0;
+}
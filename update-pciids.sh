@@ -1,11 +1,27 @@
 #!/bin/sh
 
-[ "$1" = "-q" ] && quiet=true || quiet=false
+quiet=false
+LOCAL=
+PATCH=
+while getopts "qf:p:" opt ; do
+	case $opt in
+		q)	quiet=true ;;
+		f)	LOCAL="$OPTARG" ;;
+		p)	PATCH="$OPTARG" ;;
+		*)	echo >&2 "Usage: update-pciids [-q] [-f <new-list> | -p <diff>]"
+			exit 1 ;;
+	esac
+done
+if [ -n "$LOCAL" -a -n "$PATCH" ] ; then
+	echo >&2 "update-pciids: -f and -p are mutually exclusive"
+	exit 1
+fi
 
 set -e
 SRC="https://pci-ids.ucw.cz/v2.2/pci.ids"
 DEST=pci.ids
 PCI_COMPRESSED_IDS=
+COMPILE=./compile-pciids
 GREP=grep
 
 # if pci.ids is read-only (because the filesystem is read-only),
@@ -16,60 +32,120 @@ if ! touch ${DEST} >/dev/null 2>&1 ; then
 fi
 
 if [ "$PCI_COMPRESSED_IDS" = 1 ] ; then
-	DECOMP="cat"
-	SRC="$SRC.gz"
+	COMP="gzip -9n"
 	GREP=zgrep
-elif which bzip2 >/dev/null 2>&1 ; then
-	DECOMP="bzip2 -d"
-	SRC="$SRC.bz2"
-elif which gzip >/dev/null 2>&1 ; then
-	DECOMP="gzip -d"
-	SRC="$SRC.gz"
 else
-	DECOMP="cat"
+	COMP="cat"
 fi
 
-if which curl >/dev/null 2>&1 ; then
-	DL="curl -o $DEST.new $SRC"
-    ${quiet} && DL="$DL -s -S"
-elif which wget >/dev/null 2>&1 ; then
-	DL="wget --no-timestamping -O $DEST.new $SRC"
-	${quiet} && DL="$DL -q"
-elif which lynx >/dev/null 2>&1 ; then
-	DL="eval lynx -source $SRC >$DEST.new"
+# Decompressor for a local file, chosen by its name
+decomp_for ()
+{
+	case "$1" in
+		*.gz)	echo "gzip -dc" ;;
+		*.bz2)	echo "bzip2 -dc" ;;
+		*.zst)	echo "zstd -dcq" ;;
+		*)	echo "cat" ;;
+	esac
+}
+
+if [ -n "$LOCAL" ] ; then
+	# A newer copy of the list is installed instead of downloading it
+	if [ ! -r "$LOCAL" ] ; then
+		echo >&2 "update-pciids: cannot read $LOCAL"
+		exit 1
+	fi
+	$(decomp_for "$LOCAL") <"$LOCAL" | $COMP >$DEST.neww
+elif [ -n "$PATCH" ] ; then
+	# A unified diff is applied to the installed list
+	if [ ! -f $DEST ] ; then
+		echo >&2 "update-pciids: $DEST does not exist, nothing to patch"
+		exit 1
+	fi
+	rm -f $DEST.orig.txt $DEST.new.txt
+	$(decomp_for $DEST) <$DEST >$DEST.orig.txt
+	if ! patch -s -f -o $DEST.new.txt $DEST.orig.txt <"$PATCH" >&2 ; then
+		echo >&2 "update-pciids: $PATCH does not apply to $DEST"
+		rm -f $DEST.orig.txt $DEST.new.txt $DEST.new.txt.rej
+		exit 1
+	fi
+	$COMP <$DEST.new.txt >$DEST.neww
+	rm -f $DEST.orig.txt $DEST.new.txt
 else
-	echo >&2 "update-pciids: cannot find curl, wget or lynx"
-	exit 1
-fi
+	if [ "$PCI_COMPRESSED_IDS" = 1 ] ; then
+		DECOMP="cat"
+		SRC="$SRC.gz"
+	elif which bzip2 >/dev/null 2>&1 ; then
+		DECOMP="bzip2 -d"
+		SRC="$SRC.bz2"
+	elif which gzip >/dev/null 2>&1 ; then
+		DECOMP="gzip -d"
+		SRC="$SRC.gz"
+	else
+		DECOMP="cat"
+	fi
 
-if ! $DL ; then
-	echo >&2 "update-pciids: download failed"
-	rm -f $DEST.new
-	exit 1
-fi
+	if which curl >/dev/null 2>&1 ; then
+		DL="curl -o $DEST.new $SRC"
+		${quiet} && DL="$DL -s -S"
+	elif which wget >/dev/null 2>&1 ; then
+		DL="wget --no-timestamping -O $DEST.new $SRC"
+		${quiet} && DL="$DL -q"
+	elif which lynx >/dev/null 2>&1 ; then
+		DL="eval lynx -source $SRC >$DEST.new"
+	else
+		echo >&2 "update-pciids: cannot find curl, wget or lynx"
+		exit 1
+	fi
 
-if ! $DECOMP <$DEST.new >$DEST.neww ; then
-	echo >&2 "update-pciids: decompression failed, probably truncated file"
-	exit 1
+	if ! $DL ; then
+		echo >&2 "update-pciids: download failed"
+		rm -f $DEST.new
+		exit 1
+	fi
+
+	if ! $DECOMP <$DEST.new >$DEST.neww ; then
+		echo >&2 "update-pciids: decompression failed, probably truncated file"
+		exit 1
+	fi
+	rm $DEST.new
 fi
 
 if ! $GREP >/dev/null "^C " $DEST.neww ; then
 	echo >&2 "update-pciids: missing class info, probably truncated file"
+	rm -f $DEST.neww
 	exit 1
 fi
 
+# Let the library parse the new list and build its binary index
+if [ -x $COMPILE ] ; then
+	if ! $COMPILE -i $DEST.neww -o $DEST.idx.new ; then
+		echo >&2 "update-pciids: the new list is not valid"
+		rm -f $DEST.neww $DEST.idx.new
+		exit 1
+	fi
+else
+	${quiet} || echo >&2 "update-pciids: $COMPILE not found, not building the index"
+fi
+
 if [ -f $DEST ] ; then
 	mv $DEST $DEST.old
 	# --reference is supported only by chmod from GNU file, so let's ignore any errors
 	chmod -f --reference=$DEST.old $DEST.neww 2>/dev/null || true
 fi
 mv $DEST.neww $DEST
-rm $DEST.new
+# The index records the size and mtime of the list it was built from,
+# so until it is replaced, the old one is just ignored as stale.
+if [ -f $DEST.idx.new ] ; then
+	mv $DEST.idx.new $DEST.idx
+else
+	rm -f $DEST.idx
+fi
 
 # Older versions did not compress the ids file, so let's make sure we
 # clean that up.
 if [ ${DEST%.gz} != ${DEST} ] ; then
-	rm -f ${DEST%.gz} ${DEST%.gz}.old
+	rm -f ${DEST%.gz} ${DEST%.gz}.old ${DEST%.gz}.idx
 fi
 
 ${quiet} || echo "Done."